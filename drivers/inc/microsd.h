@@ -58,10 +58,39 @@ extern "C" {
 #define ACMD23    (23 | 0x80) /**< SET_WR_BLK_ERASE_COUNT (SDC) */
 #define CMD24     (24)        /**< WRITE_BLOCK */
 #define CMD25     (25)        /**< WRITE_MULTIPLE_BLOCK */
+#define CMD32     (32)        /**< ERASE_WR_BLK_START_ADDR */
+#define CMD33     (33)        /**< ERASE_WR_BLK_END_ADDR */
+#define CMD38     (38)        /**< ERASE */
 #define CMD41     (41)        /**< SEND_OP_COND (ACMD) */
 #define CMD55     (55)        /**< APP_CMD */
 #define CMD58     (58)        /**< READ_OCR */
 
+/** Number of latency histogram bins. Bin n counts latencies below
+ *  MICROSD_LATENCY_FIRST_BIN_US << n microseconds and the last bin
+ *  counts everything longer. */
+#define MICROSD_LATENCY_BINS          12
+#define MICROSD_LATENCY_FIRST_BIN_US  250
+
+/** Latency statistics in microseconds. */
+typedef struct
+{
+  uint32_t count;
+  uint32_t worst;
+  uint64_t total;
+  uint32_t histogram[MICROSD_LATENCY_BINS];
+} MICROSD_Latency_TypeDef;
+
+/** Write statistics per call to disk_write, per sector written and per
+ *  busy wait on the card. */
+typedef struct
+{
+  MICROSD_Latency_TypeDef write;
+  MICROSD_Latency_TypeDef sector;
+  MICROSD_Latency_TypeDef busy;
+  uint32_t retries;
+  uint32_t errors;
+} MICROSD_Statistics_TypeDef;
+
 void      MICROSD_Init(void);
 void      MICROSD_Deinit(void);
 
@@ -81,10 +110,17 @@ uint8_t   MICROSD_XferSpi(uint8_t data);
 
 void      MICROSD_SpiClkFast(void);
 void      MICROSD_SpiClkSlow(void);
+void      MICROSD_SpiClkSet(uint32_t frequency);
+uint32_t  MICROSD_SpiClkGet(void);
 
 bool      MICROSD_TimeOutElapsed(void);
 void      MICROSD_TimeOutSet(uint32_t msec);
 
+void      MICROSD_StatisticsReset(void);
+uint32_t  MICROSD_StatisticsStart(void);
+void      MICROSD_StatisticsAddWrite(uint32_t startCycles, uint32_t sectors, uint32_t retries, bool success);
+const MICROSD_Statistics_TypeDef *MICROSD_StatisticsGet(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,15 +17,21 @@
 
 /*******************************************************************************
 * The original version has been modified to include an option to double
-* the speed of the SPI clock when using a fast SD card.
+* the speed of the SPI clock when using a fast SD card, to move data
+* blocks by DMA while the core sleeps in EM1, to collect write latency
+* statistics, and to set the SPI clock to a tuned frequency.
 * openacousticdevices.info
 * March 2022
 *******************************************************************************/
 
+#include <string.h>
 #include "diskio.h"
 #include "microsd.h"
 #include "em_cmu.h"
+#include "em_dma.h"
+#include "em_emu.h"
 #include "em_usart.h"
+#include "dmactrl.h"
 
 /**************************************************************************//**
  * @addtogroup MicroSd
@@ -36,6 +42,42 @@
 static uint32_t timeOut, xfersPrMsec;
 static bool doubleSpiClkFast;
 
+static DMA_CB_TypeDef dmaCallback;
+static volatile bool dmaComplete;
+static const uint16_t dmaDummyTx = 0xFFFF;
+
+static MICROSD_Statistics_TypeDef statistics;
+
+/**************************************************************************//**
+ * @brief Convert core clock cycles since a start count to microseconds.
+ *****************************************************************************/
+static uint32_t ElapsedMicroseconds(uint32_t startCycles)
+{
+  uint32_t cycles = DWT->CYCCNT - startCycles;
+
+  return (uint32_t)((uint64_t)cycles * 1000000 / CMU_ClockFreqGet(cmuClock_CORE));
+}
+
+/**************************************************************************//**
+ * @brief Add a latency measurement to a histogram.
+ *****************************************************************************/
+static void AddLatency(MICROSD_Latency_TypeDef *latency, uint32_t microseconds)
+{
+  uint32_t bin = 0;
+  uint32_t units = microseconds / MICROSD_LATENCY_FIRST_BIN_US;
+
+  while (units > 0 && bin < MICROSD_LATENCY_BINS - 1) {
+    units >>= 1;
+    bin++;
+  }
+
+  latency->count++;
+  latency->total += microseconds;
+  latency->histogram[bin]++;
+
+  if (microseconds > latency->worst) latency->worst = microseconds;
+}
+
 /**************************************************************************//**
  * @brief Wait for micro SD card ready.
  * @return 0xff: micro SD card ready, other value: micro SD card not ready.
@@ -44,6 +86,7 @@ static uint8_t WaitReady(void)
 {
   uint8_t res;
   uint32_t retryCount;
+  uint32_t startCycles = DWT->CYCCNT;
 
   /* Wait for ready in timeout of 500ms */
   retryCount = 500 * xfersPrMsec;
@@ -51,8 +94,91 @@ static uint8_t WaitReady(void)
     res = MICROSD_XferSpi(0xff);
   } while ((res != 0xFF) && --retryCount);
 
+  /* Only record the waits in which the card was busy */
+  if (retryCount < 500 * xfersPrMsec) AddLatency(&statistics.busy, ElapsedMicroseconds(startCycles));
+
   return res;
 }
+
+/**************************************************************************//**
+ * @brief DMA completion callback for the data block transfers.
+ *****************************************************************************/
+static void DmaTransferComplete(unsigned int channel, bool primary, void *user)
+{
+  (void) channel;
+  (void) primary;
+  (void) user;
+
+  dmaComplete = true;
+}
+
+/**************************************************************************//**
+ * @brief Prepare the DMA controller for a data block transfer.
+ * @param[in] buff Data buffer, which must be halfword aligned.
+ * @return true if the block can be transferred by DMA.
+ *****************************************************************************/
+static bool DmaPrepare(const uint8_t *buff)
+{
+  if ((uint32_t)buff & 1) {
+    return false;
+  }
+
+  /* Initialise the controller unless it is already running the microphone transfers */
+  CMU_ClockEnable(cmuClock_DMA, true);
+
+  if (!(DMA->STATUS & DMA_STATUS_EN)) {
+    DMA_Init_TypeDef init;
+
+    init.hprot        = 0;
+    init.controlBlock = dmaControlBlock;
+
+    DMA_Init(&init);
+  }
+
+  dmaCallback.cbFunc  = DmaTransferComplete;
+  dmaCallback.userPtr = NULL;
+
+  dmaComplete = false;
+
+  return true;
+}
+
+/**************************************************************************//**
+ * @brief Configure one channel for a halfword transfer to or from the USART.
+ *****************************************************************************/
+static void DmaConfigure(unsigned int channel, uint32_t signal, bool highPri, bool enableInt, DMA_DataInc_TypeDef srcInc, DMA_DataInc_TypeDef dstInc)
+{
+  DMA_CfgChannel_TypeDef chnlCfg;
+  DMA_CfgDescr_TypeDef   descrCfg;
+
+  chnlCfg.highPri   = highPri;
+  chnlCfg.enableInt = enableInt;
+  chnlCfg.select    = signal;
+  chnlCfg.cb        = enableInt ? &dmaCallback : NULL;
+  DMA_CfgChannel(channel, &chnlCfg);
+
+  descrCfg.dstInc  = dstInc;
+  descrCfg.srcInc  = srcInc;
+  descrCfg.size    = dmaDataSize2;
+  descrCfg.arbRate = dmaArbitrate1;
+  descrCfg.hprot   = 0;
+  DMA_CfgDescr(channel, true, &descrCfg);
+}
+
+/**************************************************************************//**
+ * @brief Sleep in EM1 until the DMA completion callback has run.
+ *****************************************************************************/
+static void DmaWait(void)
+{
+  while (!dmaComplete) {
+    /* Interrupts are masked so the completion cannot be missed between the check and the sleep */
+    __disable_irq();
+    if (!dmaComplete) {
+      EMU_EnterEM1();
+    }
+    __enable_irq();
+  }
+}
 /** @endcond */
 
 /**************************************************************************//**
@@ -224,21 +350,34 @@ int MICROSD_BlockRx(uint8_t *buff, uint32_t btr)
     timeOut = 0;
   }
 
-  /* Pipelining - The USART has two buffers of 16 bit in both
-   * directions. Make sure that at least one is in the pipe at all
-   * times to maximize throughput. */
-  MICROSD_USART->TXDOUBLE = 0xffff;
-  do {
+  if (DmaPrepare(buff)) {
+    /* Clock out dummy words for the data and CRC while the received data
+     * is stored by a second channel. The core sleeps until the data has
+     * been received. */
+    DmaConfigure(MICROSD_DMA_RX_CHANNEL, MICROSD_DMA_RX_SIGNAL, true, true, dmaDataIncNone, dmaDataInc2);
+    DmaConfigure(MICROSD_DMA_TX_CHANNEL, MICROSD_DMA_TX_SIGNAL, false, false, dmaDataIncNone, dmaDataIncNone);
+
+    DMA_ActivateBasic(MICROSD_DMA_RX_CHANNEL, true, false, buff, (void *)&MICROSD_USART->RXDOUBLE, btr / 2 - 1);
+    DMA_ActivateBasic(MICROSD_DMA_TX_CHANNEL, true, false, (void *)&MICROSD_USART->TXDOUBLE, (void *)&dmaDummyTx, btr / 2);
+
+    DmaWait();
+  } else {
+    /* Pipelining - The USART has two buffers of 16 bit in both
+     * directions. Make sure that at least one is in the pipe at all
+     * times to maximize throughput. */
     MICROSD_USART->TXDOUBLE = 0xffff;
+    do {
+      MICROSD_USART->TXDOUBLE = 0xffff;
 
-    while (!(MICROSD_USART->STATUS & USART_STATUS_RXDATAV)) ;
+      while (!(MICROSD_USART->STATUS & USART_STATUS_RXDATAV)) ;
 
-    val = MICROSD_USART->RXDOUBLE;
-    *buff++ = val;
-    *buff++ = val >> 8;
+      val = MICROSD_USART->RXDOUBLE;
+      *buff++ = val;
+      *buff++ = val >> 8;
 
-    btr -= 2;
-  } while (btr);
+      btr -= 2;
+    } while (btr);
+  }
 
   /* Next two bytes is the CRC which we discard. */
   while (!(MICROSD_USART->STATUS & USART_STATUS_RXDATAV)) ;
@@ -294,17 +433,26 @@ int MICROSD_BlockTx(const uint8_t *buff, uint8_t token)
     timeOut = 0;
   }
 
-  do {
-    /* Transmit a 512 byte data block to the SD-Card. */
+  if (DmaPrepare(buff)) {
+    /* Stream the 512 byte data block to the SD-Card by DMA while the core sleeps. */
+    DmaConfigure(MICROSD_DMA_TX_CHANNEL, MICROSD_DMA_TX_SIGNAL, false, true, dmaDataInc2, dmaDataIncNone);
 
-    val  = *buff++;
-    val |= *buff++ << 8;
-    bc  -= 2;
+    DMA_ActivateBasic(MICROSD_DMA_TX_CHANNEL, true, false, (void *)&MICROSD_USART->TXDOUBLE, (void *)buff, bc / 2 - 1);
 
-    while (!(MICROSD_USART->STATUS & USART_STATUS_TXBL)) ;
+    DmaWait();
+  } else {
+    do {
+      /* Transmit a 512 byte data block to the SD-Card. */
 
-    MICROSD_USART->TXDOUBLE = val;
-  } while (bc);
+      val  = *buff++;
+      val |= *buff++ << 8;
+      bc  -= 2;
+
+      while (!(MICROSD_USART->STATUS & USART_STATUS_TXBL)) ;
+
+      MICROSD_USART->TXDOUBLE = val;
+    } while (bc);
+  }
 
   while (!(MICROSD_USART->STATUS & USART_STATUS_TXBL)) ;
 
@@ -406,6 +554,26 @@ void MICROSD_SpiClkFast(void)
   xfersPrMsec = clkSpeed / 8000;
 }
 
+/**************************************************************************//**
+ * @brief Set SPI clock to the highest frequency at or below a limit.
+ * @param[in] frequency
+ *  Maximum SPI clock frequency in Hz.
+ *****************************************************************************/
+void MICROSD_SpiClkSet(uint32_t frequency)
+{
+  USART_BaudrateSyncSet(MICROSD_USART, 0, frequency);
+  xfersPrMsec = USART_BaudrateGet(MICROSD_USART) / 8000;
+}
+
+/**************************************************************************//**
+ * @brief Get the current SPI clock frequency.
+ * @return SPI clock frequency in Hz.
+ *****************************************************************************/
+uint32_t MICROSD_SpiClkGet(void)
+{
+  return USART_BaudrateGet(MICROSD_USART);
+}
+
 /**************************************************************************//**
  * @brief
  *  Set a timeout value. The timeout value will be decremented towards zero
@@ -429,3 +597,59 @@ bool MICROSD_TimeOutElapsed(void)
 {
   return timeOut == 0;
 }
+
+/**************************************************************************//**
+ * @brief
+ *  Clear the write latency statistics.
+ *****************************************************************************/
+void MICROSD_StatisticsReset(void)
+{
+  memset(&statistics, 0, sizeof(statistics));
+}
+
+/**************************************************************************//**
+ * @brief
+ *  Get the start count for a write measured with
+ *  @ref MICROSD_StatisticsAddWrite(). The DWT cycle counter must be enabled.
+ * @return
+ *  Core clock cycle count.
+ *****************************************************************************/
+uint32_t MICROSD_StatisticsStart(void)
+{
+  return DWT->CYCCNT;
+}
+
+/**************************************************************************//**
+ * @brief
+ *  Record a call to disk_write.
+ * @param[in] startCycles
+ *  Cycle count from @ref MICROSD_StatisticsStart() when the call started.
+ * @param[in] sectors
+ *  Number of sectors written.
+ * @param[in] retries
+ *  Number of times the write was reissued after an error.
+ * @param[in] success
+ *  True if the write eventually completed.
+ *****************************************************************************/
+void MICROSD_StatisticsAddWrite(uint32_t startCycles, uint32_t sectors, uint32_t retries, bool success)
+{
+  uint32_t microseconds = ElapsedMicroseconds(startCycles);
+
+  AddLatency(&statistics.write, microseconds);
+  AddLatency(&statistics.sector, microseconds / sectors);
+
+  statistics.retries += retries;
+
+  if (!success) statistics.errors++;
+}
+
+/**************************************************************************//**
+ * @brief
+ *  Get the write latency statistics collected since the last reset.
+ * @return
+ *  Pointer to the statistics.
+ *****************************************************************************/
+const MICROSD_Statistics_TypeDef *MICROSD_StatisticsGet(void)
+{
+  return &statistics;
+}
@@ -21,15 +21,23 @@ typedef enum {
 	RES_PARERR		/* 4: Invalid Parameter */
 } DRESULT;
 
+/* Segment of a vectored write */
+typedef struct {
+	const BYTE *buff;	/* Pointer to the data to be written */
+	UINT count;			/* Sector count */
+} DISKVEC;
+
 
 /*---------------------------------------*/
 /* Prototypes for disk control functions. */
 
 DSTATUS disk_initialize (BYTE);
+DSTATUS disk_resume (BYTE, BYTE);
 DSTATUS disk_status (BYTE);
 DRESULT disk_read (BYTE, BYTE*, DWORD, BYTE);
 #if	_READONLY == 0
 DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
+DRESULT disk_writev (BYTE, const DISKVEC*, UINT, DWORD);
 #endif
 DRESULT disk_ioctl (BYTE, BYTE, void*);
 
@@ -49,6 +57,7 @@ DRESULT disk_ioctl (BYTE, BYTE, void*);
 #define GET_SECTOR_SIZE		2	/* Get sector size (for multiple sector size (_MAX_SS >= 1024)) */
 #define GET_BLOCK_SIZE		3	/* Get erase block size (for only f_mkfs()) */
 #define CTRL_ERASE_SECTOR	4	/* Force erased a block of sectors (for only _USE_ERASE) */
+#define CTRL_TRIM			4	/* Inform device that the data on the block of sectors is no longer used (for only FF_USE_TRIM) */
 
 /* Generic command */
 #define CTRL_POWER			5	/* Get/Set power status */
@@ -248,6 +248,27 @@ typedef struct {
 
 
 
+/* Volume parameters structure (VOLPARAM) */
+
+typedef struct {
+	BYTE	fs_type;		/* Filesystem type */
+	BYTE	n_fats;			/* Number of FATs (1 or 2) */
+	BYTE	fsi_flag;		/* FSINFO flags (b7:disabled) */
+	BYTE	reserved;
+	WORD	n_rootdir;		/* Number of root directory entries (FAT12/16) */
+	WORD	csize;			/* Cluster size [sectors] */
+	DWORD	last_clst;		/* Last allocated cluster */
+	DWORD	n_fatent;		/* Number of FAT entries (number of clusters + 2) */
+	DWORD	fsize;			/* Size of an FAT [sectors] */
+	DWORD	volbase;		/* Volume base sector */
+	DWORD	fatbase;		/* FAT base sector */
+	DWORD	dirbase;		/* Root directory base sector/cluster */
+	DWORD	database;		/* Data base sector */
+	DWORD	bitbase;		/* Allocation bitmap base sector (exFAT) */
+} VOLPARAM;
+
+
+
 /* File function return code (FRESULT) */
 
 typedef enum {
@@ -304,7 +325,10 @@ FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_expand (FIL* fp, FSIZE_t szf, BYTE opt);					/* Allocate a contiguous block to the file */
+FRESULT f_lseekexpanded (FIL* fp, FSIZE_t ofs);						/* Move the file pointer of a file allocated by f_expand */
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
+FRESULT f_getvolparam (const TCHAR* path, VOLPARAM* vp);			/* Get the parameters of a mounted volume */
+FRESULT f_mountvolparam (FATFS* fs, const TCHAR* path, const VOLPARAM* vp);	/* Mount a logical drive with saved volume parameters */
 FRESULT f_mkfs (const TCHAR* path, BYTE opt, DWORD au, void* work, UINT len);	/* Create a FAT volume */
 FRESULT f_fdisk (BYTE pdrv, const DWORD* szt, void* work);			/* Divide a physical drive into some partitions */
 FRESULT f_setcp (WORD cp);											/* Set current code page */
@@ -14,6 +14,10 @@
 #include "microsd.h"
 #include "diskio.h"
 
+#define WRITE_RETRIES   2          /* Number of times a failed write is reissued */
+#define ERASE_SECTORS   0x20000    /* Number of sectors erased by each erase command */
+#define ERASE_TIMEOUT   30000      /* Timeout for each erase command in msec */
+
 static DSTATUS stat = STA_NOINIT;  /* Disk status */
 static UINT CardType;
 
@@ -35,6 +39,7 @@ DSTATUS disk_initialize (
 
   if (drv) return STA_NOINIT;                   /* Supports only single drive */
   if (stat & STA_NODISK) return stat;           /* No card in the socket */
+  if (!(stat & STA_NOINIT)) return stat;        /* Already initialized, use CTRL_INVALIDATE to force it */
 
   MICROSD_PowerOn();                            /* Force socket power on */
   MICROSD_SpiClkSlow();                         /* Start with low SPI clock. */
@@ -77,6 +82,39 @@ DSTATUS disk_initialize (
   return stat;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Resume Disk Drive                                                     */
+/*-----------------------------------------------------------------------*/
+/* Use a card which has been kept powered since it was initialized, with */
+/* the card type read by MMC_GET_TYPE at the time. The card must answer  */
+/* READ_OCR out of idle state, otherwise disk_initialize must be used.   */
+
+DSTATUS disk_resume (
+  BYTE drv,     /* Physical drive nmuber (0) */
+  BYTE type     /* Card type flags of the initialized card */
+)
+{
+  BYTE n, ocr[4];
+
+  if (drv) return STA_NOINIT;                   /* Supports only single drive */
+  if (stat & STA_NODISK) return stat;           /* No card in the socket */
+  if (!(type & (CT_MMC|CT_SDC))) return stat;   /* Not a valid card type */
+
+  MICROSD_PowerOn();                            /* Enable the SPI clock */
+  MICROSD_SpiClkFast();                         /* The card has already left identification mode */
+
+  if (MICROSD_SendCmd(CMD58, 0) == 0) {         /* Card is ready and not in idle state */
+    for (n = 0; n < 4; n++) ocr[n] = MICROSD_XferSpi(0xff);
+    if (!(type & CT_SD2) || ((ocr[0] & 0x40) ? CT_BLOCK : 0) == (type & CT_BLOCK)) {  /* Check the CCS bit agrees */
+      CardType = type;
+      stat &= ~STA_NOINIT;                      /* Clear STA_NOINIT */
+    }
+  }
+  MICROSD_Deselect();
+
+  return stat;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Disk Status                                                       */
 /*-----------------------------------------------------------------------*/
@@ -140,27 +178,91 @@ DRESULT disk_write (
   if (stat & STA_NOINIT) return RES_NOTRDY;
   if (stat & STA_PROTECT) return RES_WRPRT;
 
+  uint32_t start = MICROSD_StatisticsStart();  /* Time the whole call including retries */
+  UINT retries = 0;
+  BYTE n;
+
   if (!(CardType & CT_BLOCK)) sector *= 512;  /* Convert to byte address if needed */
 
-  if (count == 1) {                           /* Single block write */
-    if ((MICROSD_SendCmd(CMD24, sector) == 0) /* WRITE_BLOCK */
-      && MICROSD_BlockTx(buff, 0xFE))
-      count = 0;
+  for (;;) {
+    const BYTE *p = buff;
+    n = count;
+    if (n == 1) {                             /* Single block write */
+      if ((MICROSD_SendCmd(CMD24, sector) == 0) /* WRITE_BLOCK */
+        && MICROSD_BlockTx(p, 0xFE))
+        n = 0;
+    }
+    else {                                    /* Multiple block write */
+      if (CardType & CT_SDC) MICROSD_SendCmd(ACMD23, n);
+      if (MICROSD_SendCmd(CMD25, sector) == 0) {/* WRITE_MULTIPLE_BLOCK */
+        do {
+          if (!MICROSD_BlockTx(p, 0xFC)) break;
+          p += 512;
+        } while (--n);
+        if (!MICROSD_BlockTx(0, 0xFD))        /* STOP_TRAN token */
+          n = 1;
+      }
+    }
+    MICROSD_Deselect();
+    if (!n || retries == WRITE_RETRIES) break;
+    retries++;                                /* Reissue the whole write */
   }
-  else {                                      /* Multiple block write */
-    if (CardType & CT_SDC) MICROSD_SendCmd(ACMD23, count);
-    if (MICROSD_SendCmd(CMD25, sector) == 0) {/* WRITE_MULTIPLE_BLOCK */
-      do {
-        if (!MICROSD_BlockTx(buff, 0xFC)) break;
-        buff += 512;
-      } while (--count);
+
+  MICROSD_StatisticsAddWrite(start, count, retries, !n);
+
+  return n ? RES_ERROR : RES_OK;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s) from several buffers in one multiple block write      */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_writev (
+  BYTE drv,           /* Physical drive nmuber (0) */
+  const DISKVEC *vec, /* Pointer to the segments to be written */
+  UINT vcnt,          /* Number of segments */
+  DWORD sector        /* Start sector number (LBA) */
+)
+{
+  UINT retries = 0;
+  UINT count = 0;
+  UINT i, n;
+
+  if (drv || !vcnt) return RES_PARERR;
+  if (stat & STA_NOINIT) return RES_NOTRDY;
+  if (stat & STA_PROTECT) return RES_WRPRT;
+
+  for (i = 0; i < vcnt; i++) count += vec[i].count;
+  if (!count) return RES_PARERR;
+
+  uint32_t start = MICROSD_StatisticsStart();  /* Time the whole call including retries */
+
+  if (!(CardType & CT_BLOCK)) sector *= 512;  /* Convert to byte address if needed */
+
+  for (;;) {
+    n = count;
+    if (CardType & CT_SDC) MICROSD_SendCmd(ACMD23, n);
+    if (MICROSD_SendCmd(CMD25, sector) == 0) {  /* WRITE_MULTIPLE_BLOCK */
+      for (i = 0; i < vcnt && n; i++) {
+        const BYTE *p = vec[i].buff;
+        UINT k = vec[i].count;
+        while (k) {
+          if (!MICROSD_BlockTx(p, 0xFC)) break;
+          p += 512; k--; n--;
+        }
+        if (k) break;
+      }
       if (!MICROSD_BlockTx(0, 0xFD))          /* STOP_TRAN token */
-        count = 1;
+        n = 1;
     }
+    MICROSD_Deselect();
+    if (!n || retries == WRITE_RETRIES) break;
+    retries++;                                /* Reissue the whole write */
   }
-  MICROSD_Deselect();
 
-  return count ? RES_ERROR : RES_OK;
+  MICROSD_StatisticsAddWrite(start, count, retries, !n);
+
+  return n ? RES_ERROR : RES_OK;
 }
 #endif /* _READONLY */
 
@@ -237,6 +339,29 @@ DRESULT disk_ioctl (
       }
       break;
 
+    case CTRL_TRIM :                /* Erase a block of sectors (DWORD[2]: first and last sector) */
+      if (!(CardType & CT_SDC)) break;
+      if ((MICROSD_SendCmd(CMD9, 0) != 0) || !MICROSD_BlockRx(csd, 16)) break;
+      if (!(csd[0] >> 6) && !(csd[10] & 0x40)) break;  /* Check if sector erase can be applied to the card */
+      {
+        DWORD st = ((DWORD*)buff)[0], ed = ((DWORD*)buff)[1], end;
+        res = RES_OK;
+        while (res == RES_OK && st <= ed) {       /* Erase in parts so each completes within the timeout */
+          end = (ed - st >= ERASE_SECTORS) ? st + ERASE_SECTORS - 1 : ed;
+          res = RES_ERROR;
+          if ((MICROSD_SendCmd(CMD32, (CardType & CT_BLOCK) ? st : st * 512) == 0)
+            && (MICROSD_SendCmd(CMD33, (CardType & CT_BLOCK) ? end : end * 512) == 0)
+            && (MICROSD_SendCmd(CMD38, 0) == 0)) {
+            MICROSD_TimeOutSet(ERASE_TIMEOUT);     /* Wait for the card to leave the busy state */
+            while (MICROSD_XferSpi(0xff) != 0xff && !MICROSD_TimeOutElapsed()) ;
+            if (!MICROSD_TimeOutElapsed()) res = RES_OK;
+          }
+          MICROSD_Deselect();
+          st = end + 1;
+        }
+      }
+      break;
+
     case MMC_GET_TYPE :             /* Get card type flags (1 byte) */
       *ptr = CardType;
       res = RES_OK;
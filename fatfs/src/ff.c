@@ -34,6 +34,31 @@
 * November 2020
 *******************************************************************************/
 
+/*******************************************************************************
+* f_getvolparam() and f_mountvolparam() have been added, enabled by
+* FF_USE_VOLPARAM, so the parameters of a mounted volume can be saved and the
+* volume remounted from them without reading the boot record.
+* openacousticdevices.info
+* October 2026
+*******************************************************************************/
+
+/*******************************************************************************
+* f_lseekexpanded() has been added, enabled by FF_USE_EXPAND, to move the file
+* pointer of a file allocated by f_expand() without following its cluster
+* chain from the top of the file.
+* openacousticdevices.info
+* October 2026
+*******************************************************************************/
+
+/*******************************************************************************
+* f_mkfs() has been modified to start the volume of a new partition at the
+* erase block size reported by the card, rather than always at sector 63, so
+* the FAT and data area align to the card's allocation unit. The start CHS in
+* the partition table is calculated from the new start sector.
+* openacousticdevices.info
+* October 2026
+*******************************************************************************/
+
 #include "ff.h"			/* Declarations of FatFs API */
 #include "diskio.h"		/* Declarations of device I/O functions */
 
@@ -3567,6 +3592,128 @@ FRESULT f_mount (
 
 
 
+#if FF_USE_VOLPARAM
+/*-----------------------------------------------------------------------*/
+/* Get the Parameters of a Mounted Volume                                */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_getvolparam (
+	const TCHAR* path,	/* Logical drive number */
+	VOLPARAM* vp		/* Pointer to the volume parameters to be returned */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = find_volume(&path, &fs, 0);	/* Get logical drive */
+	if (res == FR_OK) {
+		vp->fs_type = fs->fs_type;
+		vp->n_fats = fs->n_fats;
+		vp->fsi_flag = fs->fsi_flag & 0x80;
+		vp->reserved = 0;
+		vp->n_rootdir = fs->n_rootdir;
+		vp->csize = fs->csize;
+#if !FF_FS_READONLY
+		vp->last_clst = fs->last_clst;
+#else
+		vp->last_clst = 0xFFFFFFFF;
+#endif
+		vp->n_fatent = fs->n_fatent;
+		vp->fsize = fs->fsize;
+		vp->volbase = fs->volbase;
+		vp->fatbase = fs->fatbase;
+		vp->dirbase = fs->dirbase;
+		vp->database = fs->database;
+#if FF_FS_EXFAT
+		vp->bitbase = fs->bitbase;
+#else
+		vp->bitbase = 0;
+#endif
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Mount a Logical Drive with Saved Volume Parameters                    */
+/*-----------------------------------------------------------------------*/
+/* The physical drive must have been initialized. The parameters are not */
+/* checked against the boot record, so they must come from the same      */
+/* volume by way of f_getvolparam().                                     */
+
+FRESULT f_mountvolparam (
+	FATFS* fs,			/* Pointer to the filesystem object */
+	const TCHAR* path,	/* Logical drive number to be mounted */
+	const VOLPARAM* vp	/* Pointer to the saved volume parameters */
+)
+{
+	FRESULT res;
+	const TCHAR *rp = path;
+
+
+	res = f_mount(fs, path, 0);			/* Register the filesystem object */
+	if (res != FR_OK) return res;
+
+	switch (vp->fs_type) {				/* Check the parameters are plausible */
+	case FS_FAT12 :
+	case FS_FAT16 :
+		if (vp->n_rootdir == 0) return FR_NO_FILESYSTEM;
+		break;
+	case FS_FAT32 :
+#if FF_FS_EXFAT
+	case FS_EXFAT :
+#endif
+		if (vp->n_rootdir != 0 || vp->dirbase < 2 || vp->dirbase >= vp->n_fatent) return FR_NO_FILESYSTEM;
+		break;
+	default :
+		return FR_NO_FILESYSTEM;
+	}
+	if (vp->n_fats != 1 && vp->n_fats != 2) return FR_NO_FILESYSTEM;
+	if (vp->csize == 0 || (vp->csize & (vp->csize - 1)) || vp->n_fatent < 3) return FR_NO_FILESYSTEM;
+
+	fs->pdrv = LD2PD(get_ldnumber(&rp));	/* Bind the logical drive and a physical drive */
+	if (disk_status(fs->pdrv) & STA_NOINIT) return FR_NOT_READY;
+
+	fs->n_fats = vp->n_fats;
+	fs->n_rootdir = vp->n_rootdir;
+	fs->csize = vp->csize;
+	fs->n_fatent = vp->n_fatent;
+	fs->fsize = vp->fsize;
+	fs->volbase = vp->volbase;
+	fs->fatbase = vp->fatbase;
+	fs->dirbase = vp->dirbase;
+	fs->database = vp->database;
+#if FF_FS_EXFAT
+	fs->bitbase = vp->bitbase;
+#endif
+#if !FF_FS_READONLY
+	fs->last_clst = vp->last_clst;		/* Continue allocation from the saved position */
+	fs->free_clst = 0xFFFFFFFF;			/* Number of free clusters is unknown */
+	fs->fsi_flag = vp->fsi_flag;
+#endif
+	fs->wflag = 0; fs->winsect = 0xFFFFFFFF;	/* Invalidate window */
+
+	fs->fs_type = vp->fs_type;		/* FAT sub-type */
+	fs->id = ++Fsid;		/* Volume mount ID */
+#if FF_USE_LFN == 1
+	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
+#if FF_FS_EXFAT
+	fs->dirbuf = DirBuf;	/* Static directory block scratchpad buuffer */
+#endif
+#endif
+#if FF_FS_RPATH != 0
+	fs->cdir = 0;			/* Initialize current directory */
+#endif
+	return FR_OK;
+}
+#endif	/* FF_USE_VOLPARAM */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Open or Create a File                                                 */
 /*-----------------------------------------------------------------------*/
@@ -5474,6 +5621,56 @@ FRESULT f_expand (
 	LEAVE_FF(fs, res);
 }
 
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Move File Pointer of a File Allocated by f_expand()                   */
+/*-----------------------------------------------------------------------*/
+/* The file must still be the single contiguous block allocated by       */
+/* f_expand(), so the cluster is calculated rather than found by         */
+/* following the cluster chain from the top of the file.                 */
+
+FRESULT f_lseekexpanded (
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t ofs		/* File pointer from top of file */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, nsect;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	if (fp->obj.sclust == 0 || ofs > fp->obj.objsize) LEAVE_FF(fs, FR_INVALID_PARAMETER);	/* Check the pointer is within the allocated block */
+
+	fp->fptr = ofs; nsect = 0;
+	if (ofs > 0) {
+		bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+		fp->clust = fp->obj.sclust + (DWORD)((ofs - 1) / bcs);	/* Cluster holding the byte before the file pointer as left by f_lseek() */
+		if (ofs % SS(fs)) {
+			nsect = clst2sect(fs, fp->clust);	/* Current sector */
+			if (nsect == 0) ABORT(fs, FR_INT_ERR);
+			nsect += (DWORD)(((ofs - 1) % bcs) / SS(fs));
+		}
+	}
+	if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
+#if !FF_FS_TINY
+		if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
+			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+		if (disk_read(fs->pdrv, fp->buf, nsect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+#endif
+		fp->sect = nsect;
+	}
+
+	LEAVE_FF(fs, res);
+}
+
 #endif /* FF_USE_EXPAND && !FF_FS_READONLY */
 
 
@@ -5626,7 +5823,7 @@ FRESULT f_mkfs (
 	} else {
 		/* Create a single-partition in this function */
 		if (disk_ioctl(pdrv, GET_SECTOR_COUNT, &sz_vol) != RES_OK) LEAVE_MKFS(FR_DISK_ERR);
-		b_vol = (opt & FM_SFD) ? 0 : 63;		/* Volume start sector */
+		b_vol = (opt & FM_SFD) ? 0 : (sz_blk > 63 ? sz_blk : 63);	/* Volume start sector, aligned to the erase block */
 		if (sz_vol < b_vol) LEAVE_MKFS(FR_MKFS_ABORTED);
 		sz_vol -= b_vol;						/* Volume size */
 	}
@@ -5993,9 +6190,10 @@ FRESULT f_mkfs (
 			st_word(buf + BS_55AA, 0xAA55);		/* MBR signature */
 			pte = buf + MBR_Table;				/* Create partition table for single partition in the drive */
 			pte[PTE_Boot] = 0;					/* Boot indicator */
-			pte[PTE_StHead] = 1;				/* Start head */
-			pte[PTE_StSec] = 1;					/* Start sector */
-			pte[PTE_StCyl] = 0;					/* Start cylinder */
+			n = b_vol / (63 * 255);				/* (Start CHS may be invalid) */
+			pte[PTE_StHead] = (BYTE)(b_vol / 63 % 255);	/* Start head */
+			pte[PTE_StSec] = (BYTE)(((n >> 2) & 0xC0) | (b_vol % 63 + 1));	/* Start sector */
+			pte[PTE_StCyl] = (BYTE)n;			/* Start cylinder */
 			pte[PTE_System] = sys;				/* System type */
 			n = (b_vol + sz_vol) / (63 * 255);	/* (End CHS may be invalid) */
 			pte[PTE_EdHead] = 254;				/* End head */
@@ -0,0 +1,39 @@
+/****************************************************************************
+ * adctuner.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __ADCTUNER_H
+#define __ADCTUNER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ADC settings structure */
+
+typedef struct {
+    uint8_t clockDivider;
+    uint8_t acquisitionCycles;
+    uint8_t oversampleRate;
+} AT_adcSettings_t;
+
+/* Calibration functions */
+
+void ADCTuner_startCalibration(void);
+
+uint32_t ADCTuner_getNumberOfCandidates(void);
+
+bool ADCTuner_getCandidate(uint32_t index, uint32_t sampleRate, uint32_t clockFrequency, AT_adcSettings_t *settings);
+
+uint32_t ADCTuner_getCost(uint32_t sampleRate, AT_adcSettings_t *settings);
+
+bool ADCTuner_addMeasurement(uint32_t sampleRate, AT_adcSettings_t *settings, uint32_t noise);
+
+bool ADCTuner_finishCalibration(void);
+
+/* Look up the cheapest calibrated settings which meet the noise target */
+
+bool ADCTuner_getSettings(uint32_t sampleRate, AT_adcSettings_t *settings);
+
+#endif /* __ADCTUNER_H */
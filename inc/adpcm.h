@@ -0,0 +1,35 @@
+/****************************************************************************
+ * adpcm.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __ADPCM_H
+#define __ADPCM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* IMA-ADPCM blocks as in WAV format 0x11. Each block holds the first sample and the step index in its header followed by two samples per byte, low nibble first */
+
+#define ADPCM_FORMAT                            0x11
+
+#define ADPCM_BLOCK_SIZE                        512
+
+#define ADPCM_BLOCK_HEADER_SIZE                 4
+
+#define ADPCM_BITS_PER_SAMPLE                   4
+
+#define ADPCM_SAMPLES_PER_BLOCK                 (2 * (ADPCM_BLOCK_SIZE - ADPCM_BLOCK_HEADER_SIZE) + 1)
+
+/* ADPCM encoder functions */
+
+uint32_t ADPCM_getNumberOfBytes(uint32_t numberOfSamples);
+
+void ADPCM_reset(uint8_t *firstPartialBlock, uint8_t *secondPartialBlock);
+
+uint32_t ADPCM_encode(int16_t *samples, uint32_t numberOfSamples, uint8_t **completedBlock);
+
+uint8_t* ADPCM_flush(void);
+
+#endif /* __ADPCM_H */
@@ -28,6 +28,9 @@
 #define AM_UNIQUE_ID_START_ADDRESS             0xFE081F0
 #define AM_UNIQUE_ID_SIZE_IN_BYTES             8
 
+#define AM_SD_CARD_IDENTIFICATION_SIZE_IN_WORDS 4
+#define AM_VOLUME_PARAMETERS_SIZE_IN_WORDS     10
+
 #define AM_BATTERY_STATE_OFFSET                3500
 #define AM_EXT_BAT_STATE_OFFSET                2400
 #define AM_BATTERY_STATE_INCREMENT             100
@@ -36,7 +39,33 @@
 
 typedef enum {AM_LOW_GAIN_RANGE, AM_NORMAL_GAIN_RANGE} AM_gainRange_t;
 
-typedef enum {AM_SD_CARD_NORMAL_SPEED, AM_SD_CARD_HIGH_SPEED} AM_sdCardSpeed_t;
+typedef enum {AM_SD_CARD_NORMAL_SPEED, AM_SD_CARD_HIGH_SPEED, AM_SD_CARD_TUNED_SPEED} AM_sdCardSpeed_t;
+
+typedef struct {
+    uint32_t volumeSerialNumber;
+    uint32_t cluster;
+    uint32_t containingCluster;
+    uint32_t containingSize;
+    uint32_t containingOffset;
+} AM_directoryLocation_t;
+
+typedef struct {
+    uint32_t volumeSerialNumber;
+    uint32_t freeClusters;
+    uint32_t clusterSize;
+} AM_freeSpace_t;
+
+typedef struct {
+    uint32_t cardIdentification[AM_SD_CARD_IDENTIFICATION_SIZE_IN_WORDS];
+    uint32_t volumeSerialNumber;
+    uint32_t allocationUnitSize;
+    uint32_t volumeParameters[AM_VOLUME_PARAMETERS_SIZE_IN_WORDS];
+} AM_fileSystemCache_t;
+
+typedef struct {
+    void *bytes;
+    uint32_t numberOfBytes;
+} AM_fileVector_t;
 
 typedef enum {AM_HF_CLK_DIV1, AM_HF_CLK_DIV2, AM_HF_CLK_DIV4} AM_highFrequencyClockDivider_t;
 
@@ -96,6 +125,9 @@ uint32_t AudioMoth_getClockFrequency();
 void AudioMoth_setClockDivider(AM_highFrequencyClockDivider_t divider);
 AM_highFrequencyClockDivider_t AudioMoth_getClockDivider(void);
 
+uint32_t AudioMoth_getCoreClockFrequency(void);
+void AudioMoth_setCoreClockDivider(AM_highFrequencyClockDivider_t divider);
+
 /* External SRAM control */
 
 bool AudioMoth_enableExternalSRAM(void);
@@ -108,8 +140,12 @@ void AudioMoth_startMicrophoneSamples(uint32_t sampleRate);
 void AudioMoth_initialiseMicrophoneInterrupts(void);
 void AudioMoth_initialiseDirectMemoryAccess(int16_t *primaryBuffer, int16_t *secondaryBuffer, uint16_t numberOfSamples);
 
+void AudioMoth_startMemoryCopy(void *dst, void *src, uint32_t numberOfBytes);
+bool AudioMoth_isMemoryCopyInProgress(void);
+
 bool AudioMoth_enableMicrophone(AM_gainRange_t gainRange, AM_gainSetting_t gainSetting, uint32_t clockDivider, uint32_t acquisitionCycles, uint32_t oversampleRate);
 void AudioMoth_disableMicrophone(void);
+void AudioMoth_setMicrophoneLeftAdjust(bool leftAdjust);
 
 /* USB */
 
@@ -202,8 +238,19 @@ void AudioMoth_setGreenLED(bool state);
 /* File system */
 
 bool AudioMoth_enableFileSystem(AM_sdCardSpeed_t speed);
+bool AudioMoth_enableFileSystemUsingCache(AM_sdCardSpeed_t speed, AM_fileSystemCache_t *cache);
 void AudioMoth_disableFileSystem(void);
 
+void AudioMoth_keepSDCardPowered(void);
+uint32_t AudioMoth_getSDCardInitialisationTime(void);
+uint32_t AudioMoth_getSDCardStartUpTime(bool *resumed);
+
+bool AudioMoth_getFileSystemCache(AM_fileSystemCache_t *cache);
+
+uint32_t AudioMoth_getSDCardAllocationUnitSize(void);
+
+bool AudioMoth_formatFileSystem(void *workBuffer, uint32_t workBufferSize);
+
 bool AudioMoth_doesFileExist(char *filename);
 
 bool AudioMoth_openFile(char *filename);
@@ -211,13 +258,24 @@ bool AudioMoth_openFileToRead(char *filename);
 bool AudioMoth_readFile(char *buffer, uint32_t bufferSize);
 bool AudioMoth_appendFile(char *filename);
 
+bool AudioMoth_expandFile(uint32_t fileSize);
+
 bool AudioMoth_seekInFile(uint32_t position);
 bool AudioMoth_writeToFile(void *bytes, uint16_t bytesToWrite);
+bool AudioMoth_writeToFileV(AM_fileVector_t *vectors, uint32_t numberOfVectors);
 
 bool AudioMoth_renameFile(char *originalFilename, char *newFilename);
+bool AudioMoth_deleteFile(char *filename);
 
 bool AudioMoth_doesDirectoryExist(char *folderName);
 bool AudioMoth_makeDirectory(char *folderName);
+bool AudioMoth_changeDirectory(char *folderName);
+
+bool AudioMoth_getDirectoryLocation(AM_directoryLocation_t *location);
+bool AudioMoth_setDirectoryLocation(AM_directoryLocation_t *location);
+
+bool AudioMoth_getFreeSpace(AM_freeSpace_t *freeSpace);
+bool AudioMoth_restoreFreeSpace(AM_freeSpace_t *freeSpace);
 
 bool AudioMoth_syncFile(void);
 bool AudioMoth_closeFile(void);
@@ -226,4 +284,7 @@ bool AudioMoth_closeFile(void);
 
 void AudioMoth_setupSWOForPrint(void);
 
+void AudioMoth_enableCycleCounter(void);
+uint32_t AudioMoth_getCycleCount(void);
+
 #endif /* __AUDIOMOTH_H */
@@ -0,0 +1,80 @@
+/****************************************************************************
+ * blockfile.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __BLOCKFILE_H
+#define __BLOCKFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Block file constants. Every block starts with a header sector and its payload fills whole sectors after it */
+
+#define BF_SECTOR_SIZE                          512
+
+#define BF_BLOCK_MAGIC                          0x4B4C4241
+
+#define BF_FILE_VERSION                         1
+
+#define BF_FLAG_TRIGGERED                       0x01
+
+/* Block type enumeration */
+
+typedef enum {BF_FILE_HEADER, BF_AUDIO, BF_SILENCE, BF_TRAILER, BF_COMPRESSED_AUDIO} BF_blockType_t;
+
+/* Block layout. The CRC covers the payload sectors followed by the header sector with the CRC set to zero */
+
+#pragma pack(push, 1)
+
+typedef struct {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t crc;
+    uint64_t sampleIndex;
+    uint32_t sequenceNumber;
+    uint32_t timestamp;
+    uint32_t numberOfSamples;
+    uint32_t payloadSize;
+    uint16_t milliseconds;
+    uint16_t peakLevel;
+    uint32_t reserved;
+} BF_blockHeader_t;
+
+typedef struct {
+    uint32_t version;
+    uint32_t sampleRate;
+    uint32_t startTime;
+    int32_t timezoneOffset;
+    uint32_t serialNumber[2];
+    uint16_t numberOfChannels;
+    uint16_t bitsPerSample;
+} BF_fileDescription_t;
+
+#pragma pack(pop)
+
+/* A compressed audio block keeps the size of each of its frames in the header sector after the block header */
+
+#define BF_MAXIMUM_NUMBER_OF_FRAMES             ((BF_SECTOR_SIZE - sizeof(BF_blockHeader_t)) / sizeof(uint16_t))
+
+/* Block file functions */
+
+uint32_t BlockFile_getNumberOfPayloadSectors(BF_blockHeader_t *header);
+
+uint16_t BlockFile_updateCRC(uint16_t crc, uint8_t *bytes, uint32_t numberOfBytes);
+
+void BlockFile_setFileHeader(uint8_t *sector, uint32_t timestamp, uint32_t milliseconds, BF_fileDescription_t *description);
+
+void BlockFile_setSilenceBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, uint32_t numberOfSamples, uint32_t timestamp, uint32_t milliseconds);
+
+void BlockFile_setAudioBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, int16_t *samples, uint32_t numberOfSamples, bool triggered, uint32_t timestamp, uint32_t milliseconds);
+
+void BlockFile_setCompressedAudioBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, uint8_t *payload, uint32_t payloadSize, uint16_t *frameSizes, uint32_t numberOfFrames, uint32_t numberOfSamples, uint32_t peakLevel, bool triggered, uint32_t timestamp, uint32_t milliseconds);
+
+bool BlockFile_setTrailerBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, uint8_t **payloadSectors, uint32_t numberOfPayloadSectors, uint32_t payloadSize, uint32_t timestamp, uint32_t milliseconds);
+
+bool BlockFile_isValidBlock(uint8_t *sector, uint8_t *payload);
+
+#endif /* __BLOCKFILE_H */
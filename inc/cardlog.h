@@ -0,0 +1,23 @@
+/****************************************************************************
+ * cardlog.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __CARDLOG_H
+#define __CARDLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Card log functions */
+
+void CardLog_reset(void);
+
+void CardLog_startNextFile(void);
+
+uint32_t CardLog_writeGuanoData(char *buffer, uint32_t bufferSize);
+
+bool CardLog_writeSummary(char *filename, char *recordingFilename, bool bufferOverflow);
+
+#endif /* __CARDLOG_H */
@@ -22,6 +22,7 @@ typedef struct {
     uint8_t enableLowVoltageCutoff;
     uint8_t enableBatteryLevelDisplay;
     uint8_t enableProprietaryFileFormat;
+    uint8_t enableDailyFolders;
     uint8_t initialSleepRecordCycles;
     uint8_t numberOfSleepRecordCycles;
     uint8_t enableOpportunisticRecording;
@@ -39,6 +40,7 @@ typedef struct {
     uint16_t lowerFilterFreq[NUMBER_OF_SETTINGS];
     uint16_t higherFilterFreq[NUMBER_OF_SETTINGS];
     uint16_t amplitudeThreshold[NUMBER_OF_SETTINGS];
+    uint8_t enableADPCM[NUMBER_OF_SETTINGS];
     uint8_t activeStartStopPeriods;
     CP_startStopPeriod_t startStopPeriods[MAXIMUM_NUMBER_OF_START_STOP_PERIODS];
     uint32_t earliestRecordingTime;
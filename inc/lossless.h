@@ -0,0 +1,39 @@
+/****************************************************************************
+ * lossless.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __LOSSLESS_H
+#define __LOSSLESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Samples are encoded in frames of LL_FRAME_SIZE samples, the last of which may be shorter. The size of each frame in bytes is kept separately.
+ *
+ * A frame whose size is two bytes per sample holds the samples unchanged as little-endian PCM. Otherwise the first byte is the order of the
+ * fixed predictor, as in FLAC, followed by that number of warm-up samples as little-endian PCM. The residuals follow as an MSB-first bit
+ * stream in partitions of LL_PARTITION_SIZE sample positions. Each partition starts with a 5-bit Rice parameter k and each residual r is
+ * mapped to u = 2r for r >= 0 and u = -2r - 1 otherwise, then written as u >> k zero bits, a one bit and the low k bits of u. The frame is
+ * padded with zero bits to a whole byte. */
+
+#define LL_FRAME_SIZE                           512
+
+#define LL_PARTITION_SIZE                       256
+
+#define LL_MAXIMUM_ORDER                        4
+
+#define LL_MAXIMUM_NUMBER_OF_FRAMES             128
+
+#define LL_MAXIMUM_NUMBER_OF_SAMPLES            (LL_FRAME_SIZE * LL_MAXIMUM_NUMBER_OF_FRAMES)
+
+/* Lossless encoder functions */
+
+uint32_t Lossless_getNumberOfFrames(uint32_t numberOfSamples);
+
+uint32_t Lossless_encode(int16_t *samples, uint32_t numberOfSamples, uint16_t *frameSizes, uint32_t *peakLevel);
+
+bool Lossless_decode(uint8_t *bytes, uint16_t *frameSizes, int16_t *samples, uint32_t numberOfSamples);
+
+#endif /* __LOSSLESS_H */
@@ -17,5 +17,9 @@
 #define MICROSD_MISOPIN         4
 #define MICROSD_CSPIN           6
 #define MICROSD_CLKPIN          5
+#define MICROSD_DMA_TX_CHANNEL  3
+#define MICROSD_DMA_RX_CHANNEL  4
+#define MICROSD_DMA_TX_SIGNAL   DMAREQ_USART2_TXBL
+#define MICROSD_DMA_RX_SIGNAL   DMAREQ_USART2_RXDATAV
 
 #endif /* __MICROSDCONFIG_H */
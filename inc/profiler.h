@@ -0,0 +1,81 @@
+/****************************************************************************
+ * profiler.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audiomoth.h"
+
+/* Profiler stage enumeration */
+
+typedef enum {PR_DMA_INTERRUPT, PR_DIGITAL_FILTER, PR_DIGITAL_FILTER_WITH_THRESHOLD, PR_WRITE_TO_FILE, PR_ENCODE_COMPRESSION_BUFFER, PR_ENCODE_BLOCK_HEADER, PR_LOSSLESS_ENCODE, PR_ADPCM_ENCODE, PR_FILTER_BENCHMARK, PR_SLEEP, PR_NUMBER_OF_STAGES} PR_stage_t;
+
+/* Profiling macros which are only active in a profiling build */
+
+#ifdef AM_ENABLE_PROFILING
+
+#define PROFILER_RESET()                        Profiler_reset()
+
+#define PROFILER_WRITE_SUMMARY(...)             Profiler_writeSummary(__VA_ARGS__)
+
+#define PROFILER_START(name)                    uint32_t name = AudioMoth_getCycleCount()
+
+#define PROFILER_STOP(name, stage)              Profiler_addMeasurement(stage, AudioMoth_getCycleCount() - name)
+
+#define PROFILER_START_SLEEP()                  Profiler_startSleep()
+
+#define PROFILER_STOP_SLEEP()                   Profiler_stopSleep()
+
+#define PROFILER_ADD_BURST(vectors, count)      Profiler_addBurst(vectors, count)
+
+#define PROFILER_ADD_TRANSFER(bufferComplete)   Profiler_addTransfer(bufferComplete)
+
+#define PROFILER_BENCHMARK_FILTER(...)          Profiler_benchmarkDigitalFilter(__VA_ARGS__)
+
+#else
+
+#define PROFILER_RESET()
+
+#define PROFILER_WRITE_SUMMARY(...)
+
+#define PROFILER_START(name)
+
+#define PROFILER_STOP(name, stage)
+
+#define PROFILER_START_SLEEP()
+
+#define PROFILER_STOP_SLEEP()
+
+#define PROFILER_ADD_BURST(vectors, count)
+
+#define PROFILER_ADD_TRANSFER(bufferComplete)
+
+#define PROFILER_BENCHMARK_FILTER(...)
+
+#endif
+
+/* Profiler functions */
+
+void Profiler_reset(void);
+
+void Profiler_addMeasurement(PR_stage_t stage, uint32_t cycles);
+
+void Profiler_startSleep(void);
+
+void Profiler_stopSleep(void);
+
+void Profiler_addBurst(AM_fileVector_t *vectors, uint32_t numberOfVectors);
+
+void Profiler_addTransfer(bool bufferComplete);
+
+void Profiler_benchmarkDigitalFilter(int16_t *buffer, uint32_t numberOfSamples, uint32_t sampleRateDivider);
+
+bool Profiler_writeSummary(char *filename, char *recordingFilename, uint32_t sampleRate, uint32_t sampleRateDivider, uint32_t numberOfSamplesInTransfer);
+
+#endif /* __PROFILER_H */
@@ -0,0 +1,22 @@
+/****************************************************************************
+ * ramfunc.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __RAMFUNC_H
+#define __RAMFUNC_H
+
+/* Functions on the recording hot path are placed in the .ramfunc section, which the linker script copies to RAM at start up */
+
+#ifdef AM_DISABLE_RAMFUNC
+
+#define AM_RAMFUNC
+
+#else
+
+#define AM_RAMFUNC                              __attribute__ ((section(".ramfunc"), noinline))
+
+#endif
+
+#endif /* __RAMFUNC_H */
@@ -0,0 +1,19 @@
+/****************************************************************************
+ * sdtest.h
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#ifndef __SDTEST_H
+#define __SDTEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* SD card test functions */
+
+bool SDTest_run(char *filename, uint8_t *buffers, uint32_t bufferSize, uint32_t numberOfBuffers);
+
+uint32_t SDTest_writeResult(char *buffer, char *speedName, bool success);
+
+#endif /* __SDTEST_H */
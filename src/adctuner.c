@@ -0,0 +1,224 @@
+/****************************************************************************
+ * adctuner.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audiomoth.h"
+#include "adctuner.h"
+
+/* ADC tuner constants */
+
+#define ADC_TUNER_TABLE_MAGIC                   0x54434441
+
+#define MAXIMUM_NUMBER_OF_ENTRIES               32
+
+#define ADC_CONVERSION_CYCLES                   12
+
+#define MAXIMUM_ADC_CLOCK_FREQUENCY             13000000
+
+#define CONVERSION_TIME_MARGIN_PERCENTAGE       75
+
+#define NOISE_TARGET_PERCENTAGE                 112
+
+#define PERCENTAGE_MULTIPLIER                   100
+
+/* Candidate settings */
+
+static const uint8_t clockDividers[] = {1, 2, 4, 8, 16};
+
+static const uint8_t acquisitionCycles[] = {1, 2, 4, 8, 16};
+
+static const uint8_t oversampleRates[] = {1, 2, 4, 8, 16};
+
+#define NUMBER_OF_CLOCK_DIVIDERS                (sizeof(clockDividers) / sizeof(uint8_t))
+
+#define NUMBER_OF_ACQUISITION_CYCLES            (sizeof(acquisitionCycles) / sizeof(uint8_t))
+
+#define NUMBER_OF_OVERSAMPLE_RATES              (sizeof(oversampleRates) / sizeof(uint8_t))
+
+/* Calibration table structures. Entries are only kept if no other entry for the same sample rate is both cheaper and quieter */
+
+typedef struct {
+    uint32_t sampleRate;
+    uint32_t cost;
+    uint32_t noise;
+    AT_adcSettings_t settings;
+    uint8_t reserved;
+} entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t numberOfEntries;
+    entry_t entries[MAXIMUM_NUMBER_OF_ENTRIES];
+} calibrationTable_t;
+
+static calibrationTable_t calibrationTable;
+
+/* Private functions */
+
+static bool isValidTable(calibrationTable_t *table) {
+
+    return table->magic == ADC_TUNER_TABLE_MAGIC && table->numberOfEntries <= MAXIMUM_NUMBER_OF_ENTRIES;
+
+}
+
+static bool dominates(entry_t *entry, uint32_t cost, uint32_t noise) {
+
+    return entry->cost <= cost && entry->noise <= noise;
+
+}
+
+/* Public calibration functions */
+
+void ADCTuner_startCalibration(void) {
+
+    calibrationTable.magic = ADC_TUNER_TABLE_MAGIC;
+
+    calibrationTable.numberOfEntries = 0;
+
+}
+
+uint32_t ADCTuner_getNumberOfCandidates(void) {
+
+    return NUMBER_OF_CLOCK_DIVIDERS * NUMBER_OF_ACQUISITION_CYCLES * NUMBER_OF_OVERSAMPLE_RATES;
+
+}
+
+bool ADCTuner_getCandidate(uint32_t index, uint32_t sampleRate, uint32_t clockFrequency, AT_adcSettings_t *settings) {
+
+    settings->oversampleRate = oversampleRates[index % NUMBER_OF_OVERSAMPLE_RATES];
+
+    index /= NUMBER_OF_OVERSAMPLE_RATES;
+
+    settings->acquisitionCycles = acquisitionCycles[index % NUMBER_OF_ACQUISITION_CYCLES];
+
+    index /= NUMBER_OF_ACQUISITION_CYCLES;
+
+    settings->clockDivider = clockDividers[index % NUMBER_OF_CLOCK_DIVIDERS];
+
+    /* Check the ADC clock is within its limit */
+
+    if (clockFrequency / settings->clockDivider > MAXIMUM_ADC_CLOCK_FREQUENCY) return false;
+
+    /* Check the conversions complete well within the sample period */
+
+    uint32_t conversionClockCycles = (settings->acquisitionCycles + ADC_CONVERSION_CYCLES) * settings->oversampleRate * settings->clockDivider;
+
+    return (uint64_t)conversionClockCycles * sampleRate * PERCENTAGE_MULTIPLIER <= (uint64_t)clockFrequency * CONVERSION_TIME_MARGIN_PERCENTAGE;
+
+}
+
+/* The ADC draws a similar charge in each ADC clock cycle of a conversion so the cost is modelled as the number of converting cycles per second. The device cannot measure its own current so this has not been checked against a current measurement */
+
+uint32_t ADCTuner_getCost(uint32_t sampleRate, AT_adcSettings_t *settings) {
+
+    return sampleRate * settings->oversampleRate * (settings->acquisitionCycles + ADC_CONVERSION_CYCLES);
+
+}
+
+bool ADCTuner_addMeasurement(uint32_t sampleRate, AT_adcSettings_t *settings, uint32_t noise) {
+
+    uint32_t cost = ADCTuner_getCost(sampleRate, settings);
+
+    /* Discard the measurement if an existing entry is as cheap and as quiet */
+
+    for (uint32_t i = 0; i < calibrationTable.numberOfEntries; i += 1) {
+
+        entry_t *entry = calibrationTable.entries + i;
+
+        if (entry->sampleRate == sampleRate && dominates(entry, cost, noise)) return false;
+
+    }
+
+    /* Remove the entries which the measurement improves on */
+
+    uint32_t numberOfEntries = 0;
+
+    for (uint32_t i = 0; i < calibrationTable.numberOfEntries; i += 1) {
+
+        entry_t *entry = calibrationTable.entries + i;
+
+        entry_t candidate = {.cost = cost, .noise = noise};
+
+        if (entry->sampleRate == sampleRate && dominates(&candidate, entry->cost, entry->noise)) continue;
+
+        calibrationTable.entries[numberOfEntries] = *entry;
+
+        numberOfEntries += 1;
+
+    }
+
+    calibrationTable.numberOfEntries = numberOfEntries;
+
+    if (numberOfEntries == MAXIMUM_NUMBER_OF_ENTRIES) return false;
+
+    /* Add the new entry */
+
+    entry_t *entry = calibrationTable.entries + numberOfEntries;
+
+    entry->sampleRate = sampleRate;
+    entry->cost = cost;
+    entry->noise = noise;
+    entry->settings = *settings;
+    entry->reserved = 0;
+
+    calibrationTable.numberOfEntries += 1;
+
+    return true;
+
+}
+
+bool ADCTuner_finishCalibration(void) {
+
+    return AudioMoth_writeToFlashUserDataPage((uint8_t*)&calibrationTable, sizeof(calibrationTable_t));
+
+}
+
+/* Public look up function */
+
+bool ADCTuner_getSettings(uint32_t sampleRate, AT_adcSettings_t *settings) {
+
+    calibrationTable_t *table = (calibrationTable_t*)AM_FLASH_USER_DATA_ADDRESS;
+
+    if (!isValidTable(table)) return false;
+
+    /* Find the lowest noise floor measured at this sample rate */
+
+    uint32_t lowestNoise = UINT32_MAX;
+
+    for (uint32_t i = 0; i < table->numberOfEntries; i += 1) {
+
+        entry_t *entry = table->entries + i;
+
+        if (entry->sampleRate == sampleRate && entry->noise < lowestNoise) lowestNoise = entry->noise;
+
+    }
+
+    if (lowestNoise == UINT32_MAX) return false;
+
+    /* Choose the cheapest settings within the noise target */
+
+    uint64_t noiseTarget = (uint64_t)lowestNoise * NOISE_TARGET_PERCENTAGE / PERCENTAGE_MULTIPLIER;
+
+    entry_t *bestEntry = NULL;
+
+    for (uint32_t i = 0; i < table->numberOfEntries; i += 1) {
+
+        entry_t *entry = table->entries + i;
+
+        if (entry->sampleRate != sampleRate || entry->noise > noiseTarget) continue;
+
+        if (bestEntry == NULL || entry->cost < bestEntry->cost) bestEntry = entry;
+
+    }
+
+    *settings = bestEntry->settings;
+
+    return true;
+
+}
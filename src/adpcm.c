@@ -0,0 +1,251 @@
+/****************************************************************************
+ * adpcm.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ramfunc.h"
+#include "adpcm.h"
+
+/* Encoder constants */
+
+#define MAXIMUM_STEP_INDEX                      88
+
+#define MIN(a, b)                               ((a) < (b) ? (a) : (b))
+
+#define MAX(a, b)                               ((a) > (b) ? (a) : (b))
+
+/* IMA-ADPCM tables */
+
+static const int16_t stepTable[MAXIMUM_STEP_INDEX + 1] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+/* Encoder state. The block which is still being filled alternates between the two partial block buffers so a completed one can be written while the next starts */
+
+static int32_t predictor;
+
+static int32_t stepIndex;
+
+static uint8_t *partialBlocks[2];
+
+static uint32_t partialBlockIndex;
+
+static uint32_t samplesInPartialBlock;
+
+/* Private functions */
+
+static inline void writeBlockHeader(uint8_t *block, int16_t sample, uint8_t index) {
+
+    block[0] = sample & 0xFF;
+    block[1] = (uint16_t)sample >> 8;
+    block[2] = index;
+    block[3] = 0;
+
+}
+
+/* The quantiser uses masks rather than branches so each of the three bits costs the same few instructions */
+
+static inline uint32_t encodeSample(int32_t sample) {
+
+    int32_t step = stepTable[stepIndex];
+
+    int32_t difference = sample - predictor;
+
+    uint32_t sign = (difference >> 31) & 8;
+
+    difference = difference < 0 ? -difference : difference;
+
+    int32_t prediction = step >> 3;
+
+    uint32_t nibble = 0;
+
+    for (uint32_t bit = 4; bit > 0; bit >>= 1) {
+
+        int32_t mask = ~((difference - step) >> 31);
+
+        nibble |= bit & mask;
+
+        difference -= step & mask;
+
+        prediction += step & mask;
+
+        step >>= 1;
+
+    }
+
+    predictor += sign ? -prediction : prediction;
+
+    predictor = MAX(INT16_MIN, MIN(INT16_MAX, predictor));
+
+    stepIndex = MAX(0, MIN(MAXIMUM_STEP_INDEX, stepIndex + indexTable[nibble]));
+
+    return nibble | sign;
+
+}
+
+/* Encode samples into a block starting at the given sample position. Each output byte is only written once every input sample it could overlap has been read, so whole blocks can be encoded in place */
+
+static void encodeIntoBlock(uint8_t *block, uint32_t position, int16_t *samples, uint32_t numberOfSamples) {
+
+    uint32_t i = 0;
+
+    bool headerPending = false;
+
+    int16_t headerSample = 0;
+
+    uint8_t headerIndex = 0;
+
+    if (position == 0 && numberOfSamples > 0) {
+
+        headerSample = samples[0];
+
+        headerIndex = stepIndex;
+
+        predictor = headerSample;
+
+        headerPending = true;
+
+        position = 1;
+
+        i = 1;
+
+    }
+
+    uint32_t byte = (position - 1) & 1 ? block[ADPCM_BLOCK_HEADER_SIZE + (position - 1) / 2] : 0;
+
+    for (; i < numberOfSamples; i += 1, position += 1) {
+
+        int32_t sample = samples[i];
+
+        if (headerPending) {
+
+            writeBlockHeader(block, headerSample, headerIndex);
+
+            headerPending = false;
+
+        }
+
+        uint32_t nibble = encodeSample(sample);
+
+        if ((position - 1) & 1) {
+
+            block[ADPCM_BLOCK_HEADER_SIZE + (position - 1) / 2] = byte | nibble << ADPCM_BITS_PER_SAMPLE;
+
+        } else {
+
+            byte = nibble;
+
+        }
+
+    }
+
+    if (headerPending) writeBlockHeader(block, headerSample, headerIndex);
+
+    if ((position - 1) & 1) block[ADPCM_BLOCK_HEADER_SIZE + (position - 1) / 2] = byte;
+
+}
+
+/* Public functions */
+
+uint32_t ADPCM_getNumberOfBytes(uint32_t numberOfSamples) {
+
+    return (numberOfSamples + ADPCM_SAMPLES_PER_BLOCK - 1) / ADPCM_SAMPLES_PER_BLOCK * ADPCM_BLOCK_SIZE;
+
+}
+
+void ADPCM_reset(uint8_t *firstPartialBlock, uint8_t *secondPartialBlock) {
+
+    partialBlocks[0] = firstPartialBlock;
+
+    partialBlocks[1] = secondPartialBlock;
+
+    partialBlockIndex = 0;
+
+    samplesInPartialBlock = 0;
+
+    predictor = 0;
+
+    stepIndex = 0;
+
+}
+
+/* Whole blocks are written back over the start of the samples. A partial block completed by these samples comes before them in the stream */
+
+AM_RAMFUNC uint32_t ADPCM_encode(int16_t *samples, uint32_t numberOfSamples, uint8_t **completedBlock) {
+
+    uint8_t *output = (uint8_t*)samples;
+
+    uint32_t numberOfBytes = 0;
+
+    uint32_t index = 0;
+
+    *completedBlock = NULL;
+
+    if (samplesInPartialBlock > 0) {
+
+        uint32_t numberOfSamplesToEncode = MIN(numberOfSamples, ADPCM_SAMPLES_PER_BLOCK - samplesInPartialBlock);
+
+        encodeIntoBlock(partialBlocks[partialBlockIndex], samplesInPartialBlock, samples, numberOfSamplesToEncode);
+
+        samplesInPartialBlock += numberOfSamplesToEncode;
+
+        index = numberOfSamplesToEncode;
+
+        if (samplesInPartialBlock == ADPCM_SAMPLES_PER_BLOCK) {
+
+            *completedBlock = partialBlocks[partialBlockIndex];
+
+            partialBlockIndex ^= 1;
+
+            samplesInPartialBlock = 0;
+
+        }
+
+    }
+
+    while (numberOfSamples - index >= ADPCM_SAMPLES_PER_BLOCK) {
+
+        encodeIntoBlock(output + numberOfBytes, 0, samples + index, ADPCM_SAMPLES_PER_BLOCK);
+
+        numberOfBytes += ADPCM_BLOCK_SIZE;
+
+        index += ADPCM_SAMPLES_PER_BLOCK;
+
+    }
+
+    if (index < numberOfSamples) {
+
+        memset(partialBlocks[partialBlockIndex], 0, ADPCM_BLOCK_SIZE);
+
+        encodeIntoBlock(partialBlocks[partialBlockIndex], 0, samples + index, numberOfSamples - index);
+
+        samplesInPartialBlock = numberOfSamples - index;
+
+    }
+
+    return numberOfBytes;
+
+}
+
+/* The rest of the last block is left as zero nibbles, which the sample count in the fact chunk excludes */
+
+uint8_t* ADPCM_flush(void) {
+
+    if (samplesInPartialBlock == 0) return NULL;
+
+    samplesInPartialBlock = 0;
+
+    return partialBlocks[partialBlockIndex];
+
+}
@@ -6,6 +6,7 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -41,6 +42,7 @@
 #include "usbdescriptors.h"
 
 #include "audioMoth.h"
+#include "ramfunc.h"
 
 /* Time constants */
 
@@ -51,6 +53,70 @@
 #define MILLISECONDS_IN_SECOND                    1000
 #define SECONDS_IN_MINUTE                         60
 
+/* SD card constants */
+
+#define AM_SD_CARD_SECTOR_SIZE                    512
+#define AM_SD_CARD_MAXIMUM_SECTORS_IN_WRITE       255
+#define AM_SD_CARD_MAXIMUM_VECTORS_IN_WRITE       8
+#define AM_FAT_FIRST_DATA_CLUSTER                 2
+
+/* SD card format constants */
+
+#define AM_SD_CARD_SDHC_MAXIMUM_SECTORS           0x4000000
+#define AM_FAT32_CLUSTER_SIZE                     32768
+#define AM_EXFAT_CLUSTER_SIZE                     131072
+
+/* SD card clock tuning constants */
+
+#define AM_SD_CARD_CLOCK_TEST_REPEATS             4
+#define AM_SD_CARD_CLOCK_TEST_MULTIPLIER          0x9D
+
+#define AM_SD_CARD_REGISTER_LENGTH                16
+#define AM_SD_CARD_CSD_TRAN_SPEED                 3
+#define AM_SD_CARD_IDENTITY_MULTIPLIER            31
+
+#define AM_MBR_FIRST_PARTITION_OFFSET             446
+#define AM_MBR_PARTITION_START_OFFSET             8
+#define AM_MBR_SIGNATURE_OFFSET                   510
+
+/* Volume serial number constants */
+
+#define AM_FAT_VOLUME_SERIAL_NUMBER_OFFSET        39
+#define AM_FAT32_VOLUME_SERIAL_NUMBER_OFFSET      67
+#define AM_EXFAT_VOLUME_SERIAL_NUMBER_OFFSET      100
+
+#define HZ_IN_KHZ                                 1000
+
+/* DMA transfer constants */
+
+#define AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR      1024
+/* Chaining is opt-in until it has been checked on hardware. Otherwise a single descriptor per channel keeps the ping-pong transfer */
+
+#ifdef AM_ENABLE_CHAINED_DMA
+#define AM_DMA_MAXIMUM_CHAINED_DESCRIPTORS        16
+#else
+#define AM_DMA_MAXIMUM_CHAINED_DESCRIPTORS        1
+#endif
+
+#define AM_DMA_NUMBER_OF_CHAINED_CHANNELS         2
+#define AM_DMA_MEMORY_COPY_CHANNEL                2
+
+/* EBI timing constants */
+
+#define AM_EBI_READ_SETUP_CYCLES                  2
+#define AM_EBI_READ_STROBE_CYCLES                 3
+#define AM_EBI_READ_HOLD_CYCLES                   1
+
+#define AM_EBI_WRITE_SETUP_CYCLES                 0
+#define AM_EBI_WRITE_STROBE_CYCLES                6
+#define AM_EBI_WRITE_HOLD_CYCLES                  0
+
+#define AM_EBI_TIMING_MARGIN_CYCLES               1
+#define AM_EBI_CALIBRATION_SIZE_IN_SAMPLES        2048
+#define AM_EBI_CALIBRATION_MULTIPLIER             0x9E37
+
+#define HZ_IN_MHZ                                 1000000
+
 /* USB EM2 wake constant */
 
 #define AM_USB_EM2_RTC_WAKEUP_INTERVAL            10
@@ -86,15 +152,25 @@
 #define AM_BURTC_TIME_OFFSET_LOW                  0
 #define AM_BURTC_TIME_OFFSET_HIGH                 1
 #define AM_BURTC_CLOCK_SET_FLAG                   2
-#define AM_BURTC_WATCH_DOG_FLAG                   3
+#define AM_BURTC_SD_CARD_STATE                    3
 #define AM_BURTC_INITIAL_POWER_UP_FLAG            4
 #define AM_BURTC_HARDWARE_VERSION                 5
+#define AM_BURTC_EBI_TIMING                       6
+#define AM_BURTC_SD_CARD_CLOCK                    7
 
 #define AM_BURTC_CANARY_VALUE                     0x11223344
 
 #define AM_BURTC_TOTAL_REGISTERS                  128
 #define AM_BURTC_RESERVED_REGISTERS               8
 
+/* SD card state register fields. The initialisation time is kept when the card is powered down */
+
+#define AM_SD_CARD_STATE_TYPE_MASK                0x000000FF
+#define AM_SD_CARD_STATE_POWERED                  0x00000100
+#define AM_SD_CARD_STATE_HOLD                     0x00000200
+#define AM_SD_CARD_STATE_INITIALISATION_TIME_MASK 0xFFFF0000
+#define AM_SD_CARD_STATE_INITIALISATION_TIME_SHIFT 16
+
 /* USB message types */
 
 #define AM_USB_BUFFERSIZE                         64
@@ -171,17 +247,54 @@ typedef struct {
 STATIC_UBUF(receiveBuffer, 2 * AM_USB_BUFFERSIZE);
 STATIC_UBUF(transmitBuffer, 2 * AM_USB_BUFFERSIZE);
 
+/* Watch dog variable. The reset cause is read on every start up so the flag does not need a retention register */
+
+static bool watchdogResetOccurred;
+
 /* SD card variables */
 
 static FATFS fatfs;
 static FIL file;
 static UINT bw;
 
+/* Contiguous file variables */
+
+static bool contiguousFile;
+static uint32_t contiguousFileSize;
+static uint32_t contiguousFileSector;
+static uint32_t contiguousFilePosition;
+static uint8_t contiguousFilePartialSector[AM_SD_CARD_SECTOR_SIZE] __attribute__ ((aligned(4)));
+
+/* SD card allocation unit and volume variables */
+
+static uint32_t sdCardAllocationUnitSize;
+
+static uint32_t volumeSerialNumber;
+
+static uint32_t sdCardIdentification[AM_SD_CARD_IDENTIFICATION_SIZE_IN_WORDS];
+
+/* SD card start up variables */
+
+static bool sdCardResumed;
+
+static uint32_t sdCardStartUpTime;
+
+/* Check the saved volume parameters fit in the file system cache */
+
+typedef char volumeParametersSizeCheck[sizeof(VOLPARAM) <= AM_VOLUME_PARAMETERS_SIZE_IN_WORDS * sizeof(uint32_t) ? 1 : -1];
+
 /* DMA variables */
 
 static DMA_CB_TypeDef cb;
 static uint16_t numberOfSamplesPerTransfer;
 
+/* Chained DMA variables */
+
+static uint32_t numberOfChainedDescriptors;
+static DMA_CB_TypeDef chainedCb[AM_DMA_NUMBER_OF_CHAINED_CHANNELS];
+static int16_t *chainedBuffers[AM_DMA_NUMBER_OF_CHAINED_CHANNELS];
+static DMA_DESCRIPTOR_TypeDef chainedDescriptors[AM_DMA_NUMBER_OF_CHAINED_CHANNELS][AM_DMA_MAXIMUM_CHAINED_DESCRIPTORS];
+
 /* Delay timer variable */
 
 static volatile bool delayTimmerRunning;
@@ -205,6 +318,9 @@ static volatile bool shouldFlashFirmware;
 static void setupGPIO(void);
 static void enableEBI(void);
 static void disableEBI(void);
+static void calibrateEBI(void);
+static bool testEBITiming(void);
+static void tuneSDCardClock(void);
 static void setupBackupRTC(bool useLFXO);
 static void setupBackupDomain(bool useLFXO);
 static void setupWatchdogTimer(void);
@@ -328,6 +444,18 @@ void AudioMoth_initialise() {
 
         BURTC_RetRegSet(AM_BURTC_TIME_OFFSET_HIGH, 0);
 
+        /* Clear the EBI timing calibration */
+
+        BURTC_RetRegSet(AM_BURTC_EBI_TIMING, 0);
+
+        /* Clear the SD card clock calibration */
+
+        BURTC_RetRegSet(AM_BURTC_SD_CARD_CLOCK, 0);
+
+        /* Clear the SD card state so the card is powered down */
+
+        BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, 0);
+
         /* Set the initial power up flag */
 
         BURTC_RetRegSet(AM_BURTC_INITIAL_POWER_UP_FLAG,  AM_BURTC_CANARY_VALUE);
@@ -350,20 +478,16 @@ void AudioMoth_initialise() {
 
     /* If this was a watch dog timer reset then record that this occurred */
 
-    if (resetCause & RMU_RSTCAUSE_WDOGRST) {
-
-        BURTC_RetRegSet(AM_BURTC_WATCH_DOG_FLAG, AM_BURTC_CANARY_VALUE);
-
-    } else {
-
-        BURTC_RetRegSet(AM_BURTC_WATCH_DOG_FLAG, 0);
-
-    }
+    watchdogResetOccurred = resetCause & RMU_RSTCAUSE_WDOGRST;
 
     /* Put GPIO pins in correct state */
 
     setupGPIO();
 
+    /* A held SD card stays powered through this wake but is turned off at the next power down unless it is held again */
+
+    BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE) & ~AM_SD_CARD_STATE_HOLD);
+
     /* Enable interrupt on USB switch position to wake from EM2 */
 
     GPIO_PinModeSet(SWITCH_1_GPIOPORT, SWITCH_1_SENSE, gpioModeInput, 0);
@@ -456,6 +580,22 @@ void AudioMoth_setClockDivider(AM_highFrequencyClockDivider_t divider) {
 
 }
 
+/* The core clock divider leaves HFPERCLK, and so the sample timer, ADC and SPI clocks, unchanged */
+
+uint32_t AudioMoth_getCoreClockFrequency(void) {
+
+    return CMU_ClockFreqGet(cmuClock_CORE);
+
+}
+
+void AudioMoth_setCoreClockDivider(AM_highFrequencyClockDivider_t divider) {
+
+    CMU_ClkDiv_TypeDef clockDivider = divider == AM_HF_CLK_DIV4 ? cmuClkDiv_4 : divider == AM_HF_CLK_DIV2 ? cmuClkDiv_2 : cmuClkDiv_1;
+
+    CMU_ClockDivSet(cmuClock_CORE, clockDivider);
+
+}
+
 AM_highFrequencyClockDivider_t AudioMoth_getClockDivider() {
 
     CMU_ClkDiv_TypeDef clockDivider = CMU_ClockDivGet(cmuClock_HF);
@@ -546,7 +686,60 @@ void TIMER1_IRQHandler(void) {
 
 }
 
-static void transferComplete(unsigned int channel, bool isPrimaryBuffer, void *user) {
+AM_RAMFUNC static void activateChainedTransfer(unsigned int channel) {
+
+    /* Each descriptor in the chain fills the next block of the destination buffer */
+
+    DMA_CfgDescrSGAlt_TypeDef descrCfg;
+
+    descrCfg.src = (void*)&(ADC0->SINGLEDATA);
+    descrCfg.srcInc = dmaDataIncNone;
+    descrCfg.dstInc = dmaDataInc2;
+    descrCfg.size = dmaDataSize2;
+    descrCfg.arbRate = dmaArbitrate1;
+    descrCfg.hprot = 0;
+    descrCfg.nMinus1 = AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR - 1;
+    descrCfg.peripheral = true;
+
+    for (uint32_t i = 0; i < numberOfChainedDescriptors; i += 1) {
+
+        descrCfg.dst = (void*)(chainedBuffers[channel] + i * AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR);
+
+        DMA_CfgDescrScatterGather(chainedDescriptors[channel], i, &descrCfg);
+
+    }
+
+    DMA_ActivateScatterGather(channel, false, chainedDescriptors[channel], numberOfChainedDescriptors);
+
+}
+
+AM_RAMFUNC static void chainedTransferComplete(unsigned int channel, bool isPrimaryBuffer, void *user) {
+
+    /* The other channel took over when this chain finished so give it priority before this channel is re-armed */
+
+    unsigned int otherChannel = channel == 0 ? 1 : 0;
+
+    DMA->CHPRIS = 1 << otherChannel;
+
+    DMA->CHPRIC = 1 << channel;
+
+    /* Handle the completed chain and re-arm the channel */
+
+    int16_t *nextBuffer = NULL;
+
+    AudioMoth_handleDirectMemoryAccessInterrupt(channel == 0, &nextBuffer);
+
+    if (nextBuffer != NULL) chainedBuffers[channel] = nextBuffer;
+
+    activateChainedTransfer(channel);
+
+    /* Feed the watch dog timer */
+
+    WDOG_Feed();
+
+}
+
+AM_RAMFUNC static void transferComplete(unsigned int channel, bool isPrimaryBuffer, void *user) {
 
     int16_t *nextBuffer = NULL;
 
@@ -655,7 +848,11 @@ void AudioMoth_initialiseDirectMemoryAccess(int16_t *primaryBuffer, int16_t *sec
 
     numberOfSamplesPerTransfer = numberOfSamples;
 
-    if (numberOfSamplesPerTransfer > 1024) numberOfSamplesPerTransfer = 1024;
+    if (numberOfSamplesPerTransfer > AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR * AM_DMA_MAXIMUM_CHAINED_DESCRIPTORS) numberOfSamplesPerTransfer = AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR * AM_DMA_MAXIMUM_CHAINED_DESCRIPTORS;
+
+    numberOfChainedDescriptors = numberOfSamplesPerTransfer / AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR;
+
+    if (numberOfChainedDescriptors > 0) numberOfSamplesPerTransfer = numberOfChainedDescriptors * AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR;
 
     /* Start the clock */
 
@@ -670,6 +867,51 @@ void AudioMoth_initialiseDirectMemoryAccess(int16_t *primaryBuffer, int16_t *sec
 
     DMA_Init(&dmaInit);
 
+    /* Set up the memory copy channel without an interrupt. Its progress is polled */
+
+    DMA_CfgChannel_TypeDef copyCfg;
+
+    copyCfg.highPri = false;
+    copyCfg.enableInt = false;
+    copyCfg.select = 0;
+    copyCfg.cb = NULL;
+
+    DMA_CfgChannel(AM_DMA_MEMORY_COPY_CHANNEL, &copyCfg);
+
+    /* Transfers larger than a single descriptor alternate between two channels on the same request, each running a chain of descriptors */
+
+    if (numberOfChainedDescriptors > 1) {
+
+        chainedBuffers[0] = primaryBuffer;
+        chainedBuffers[1] = secondaryBuffer;
+
+        for (uint32_t channel = 0; channel < AM_DMA_NUMBER_OF_CHAINED_CHANNELS; channel += 1) {
+
+            chainedCb[channel].cbFunc = chainedTransferComplete;
+            chainedCb[channel].userPtr = NULL;
+
+            DMA_CfgChannel_TypeDef chnlCfg;
+
+            chnlCfg.highPri = channel == 0;
+            chnlCfg.enableInt = true;
+            chnlCfg.select = DMAREQ_ADC0_SINGLE;
+            chnlCfg.cb = &chainedCb[channel];
+
+            DMA_CfgChannel(channel, &chnlCfg);
+
+        }
+
+        /* The low priority channel only receives requests once the first chain has completed */
+
+        activateChainedTransfer(0);
+        activateChainedTransfer(1);
+
+        return;
+
+    }
+
+    numberOfChainedDescriptors = 0;
+
     /* Setting up call-back function */
 
     cb.cbFunc = transferComplete;
@@ -679,7 +921,7 @@ void AudioMoth_initialiseDirectMemoryAccess(int16_t *primaryBuffer, int16_t *sec
 
     DMA_CfgChannel_TypeDef chnlCfg;
 
-    chnlCfg.highPri = false;
+    chnlCfg.highPri = true;
     chnlCfg.enableInt = true;
     chnlCfg.select = DMAREQ_ADC0_SINGLE;
     chnlCfg.cb = &cb;
@@ -713,6 +955,62 @@ void AudioMoth_initialiseDirectMemoryAccess(int16_t *primaryBuffer, int16_t *sec
 
 }
 
+AM_RAMFUNC void AudioMoth_startMemoryCopy(void *dst, void *src, uint32_t numberOfBytes) {
+
+    /* Wait for any previous copy to complete */
+
+    while (AudioMoth_isMemoryCopyInProgress()) { }
+
+    /* Use the largest transfer size allowed by the alignment of the addresses and the length */
+
+    uint32_t alignment = (uint32_t)dst | (uint32_t)src | numberOfBytes;
+
+    DMA_CfgDescr_TypeDef descrCfg;
+
+    uint32_t numberOfTransfers;
+
+    if (alignment & 0x01) {
+
+        descrCfg.size = dmaDataSize1;
+        descrCfg.dstInc = dmaDataInc1;
+        numberOfTransfers = numberOfBytes;
+
+    } else if (alignment & 0x02) {
+
+        descrCfg.size = dmaDataSize2;
+        descrCfg.dstInc = dmaDataInc2;
+        numberOfTransfers = numberOfBytes / 2;
+
+    } else {
+
+        descrCfg.size = dmaDataSize4;
+        descrCfg.dstInc = dmaDataInc4;
+        numberOfTransfers = numberOfBytes / 4;
+
+    }
+
+    if (numberOfTransfers == 0) return;
+
+    if (numberOfTransfers > AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR) numberOfTransfers = AM_DMA_MAXIMUM_SAMPLES_IN_DESCRIPTOR;
+
+    /* Arbitrate after every transfer so the microphone samples are not delayed */
+
+    descrCfg.srcInc = descrCfg.dstInc;
+    descrCfg.arbRate = dmaArbitrate1;
+    descrCfg.hprot = 0;
+
+    DMA_CfgDescr(AM_DMA_MEMORY_COPY_CHANNEL, true, &descrCfg);
+
+    DMA_ActivateAuto(AM_DMA_MEMORY_COPY_CHANNEL, true, dst, src, numberOfTransfers - 1);
+
+}
+
+AM_RAMFUNC bool AudioMoth_isMemoryCopyInProgress(void) {
+
+    return DMA_ChannelEnabled(AM_DMA_MEMORY_COPY_CHANNEL);
+
+}
+
 bool AudioMoth_enableMicrophone(AM_gainRange_t gainRain, AM_gainSetting_t gain, uint32_t clockDivider, uint32_t acquisitionCycles, uint32_t oversampleRate) {
 
     /* Check for external microphone */
@@ -829,6 +1127,22 @@ void AudioMoth_disableMicrophone(void) {
 
 }
 
+void AudioMoth_setMicrophoneLeftAdjust(bool leftAdjust) {
+
+    /* Left adjusted 12-bit differential samples are scaled by 16 within the ADC */
+
+    if (leftAdjust) {
+
+        ADC0->SINGLECTRL |= ADC_SINGLECTRL_ADJ_LEFT;
+
+    } else {
+
+        ADC0->SINGLECTRL &= ~_ADC_SINGLECTRL_ADJ_MASK;
+
+    }
+
+}
+
 bool AudioMoth_enableExternalSRAM(void) {
 
     /* Check hardware version */
@@ -1129,6 +1443,10 @@ void AudioMoth_deepSleep(void) {
 
 void AudioMoth_powerDown() {
 
+    /* Turn the SD card off even if it was held */
+
+    BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE) & AM_SD_CARD_STATE_INITIALISATION_TIME_MASK);
+
     /* Set up GPIO pins */
 
     setupGPIO();
@@ -2466,7 +2784,7 @@ static void setupWatchdogTimer(void) {
 
 bool AudioMoth_hasWatchdogResetOccurred(void) {
 
-    return BURTC_RetRegGet(AM_BURTC_WATCH_DOG_FLAG) == AM_BURTC_CANARY_VALUE;
+    return watchdogResetOccurred;
 
 }
 
@@ -2629,160 +2947,788 @@ void AudioMoth_setGreenLED(bool state) {
 
 }
 
-/* Functions to handle file system */
+/* Private functions to stream data into a contiguous file */
 
-bool AudioMoth_enableFileSystem(AM_sdCardSpeed_t speed) {
+static bool writeContiguousSectors(uint8_t *bytes, uint32_t numberOfSectors) {
 
-    /* Check hardware version */
+    while (numberOfSectors > 0) {
 
-    AM_hardwareVersion_t hardwareVersion = BURTC_RetRegGet(AM_BURTC_HARDWARE_VERSION);
+        uint32_t sectorsToWrite = MIN(numberOfSectors, AM_SD_CARD_MAXIMUM_SECTORS_IN_WRITE);
 
-    if (hardwareVersion >= AM_VERSION_4) return false;
+        uint32_t sector = contiguousFileSector + contiguousFilePosition / AM_SD_CARD_SECTOR_SIZE;
 
-    /* Turn SD card on */
+        if (disk_write(0, bytes, sector, sectorsToWrite) != RES_OK) return false;
 
-    GPIO_PinOutClear(SDEN_GPIOPORT, SD_ENABLE_N);
+        bytes += sectorsToWrite * AM_SD_CARD_SECTOR_SIZE;
 
-    /* Initialise MicroSD driver */
+        contiguousFilePosition += sectorsToWrite * AM_SD_CARD_SECTOR_SIZE;
 
-    if (speed == AM_SD_CARD_HIGH_SPEED) MICROSD_DoubleSpiClkFast();
+        numberOfSectors -= sectorsToWrite;
 
-    MICROSD_Init();
+    }
 
-    /* Check SD card status */
+    return true;
 
-    DSTATUS resCard = disk_initialize(0);
+}
 
-    if (resCard == STA_NOINIT || resCard == STA_NODISK || resCard == STA_PROTECT) {
-        return false;
-    }
+static bool writeToContiguousFile(uint8_t *bytes, uint32_t bytesToWrite) {
 
-    /* Initialise file system */
+    while (bytesToWrite > 0) {
 
-    if (f_mount(&fatfs, "", 1) != FR_OK) {
-        return false;
-    }
+        uint32_t offset = contiguousFilePosition % AM_SD_CARD_SECTOR_SIZE;
 
-    /* Return success */
+        if (offset == 0 && bytesToWrite >= AM_SD_CARD_SECTOR_SIZE) {
 
-    return true;
+            /* Write whole sectors straight from the caller's buffer */
 
-}
+            uint32_t numberOfSectors = bytesToWrite / AM_SD_CARD_SECTOR_SIZE;
 
-void AudioMoth_disableFileSystem(void) {
+            if (!writeContiguousSectors(bytes, numberOfSectors)) return false;
 
-    /* Check hardware version */
+            bytes += numberOfSectors * AM_SD_CARD_SECTOR_SIZE;
 
-    AM_hardwareVersion_t hardwareVersion = BURTC_RetRegGet(AM_BURTC_HARDWARE_VERSION);
+            bytesToWrite -= numberOfSectors * AM_SD_CARD_SECTOR_SIZE;
 
-    if (hardwareVersion >= AM_VERSION_4) return;
+        } else {
 
-    /* Disable the SD card pins */
+            /* Collect a partial sector and write it once it is complete */
 
-    MICROSD_Deinit();
+            uint32_t numberOfBytes = MIN(bytesToWrite, AM_SD_CARD_SECTOR_SIZE - offset);
 
-    /* Turn SD card off*/
+            memcpy(contiguousFilePartialSector + offset, bytes, numberOfBytes);
 
-    GPIO_PinOutSet(SDEN_GPIOPORT, SD_ENABLE_N);
+            bytes += numberOfBytes;
 
-}
+            bytesToWrite -= numberOfBytes;
 
-bool AudioMoth_doesFileExist(char *filename){
+            if (offset + numberOfBytes == AM_SD_CARD_SECTOR_SIZE) {
 
-    FRESULT res = f_stat(filename, NULL);
+                contiguousFilePosition -= offset;
+
+                if (!writeContiguousSectors(contiguousFilePartialSector, 1)) return false;
+
+            } else {
+
+                contiguousFilePosition += numberOfBytes;
+
+            }
+
+        }
 
-    if (res != FR_OK) {
-        return false;
     }
 
     return true;
 
 }
 
-bool AudioMoth_openFile(char *filename) {
+static bool writeVectorsToContiguousFile(AM_fileVector_t *vectors, uint32_t numberOfVectors) {
 
-    /* Open a file for writing. Overwrite existing file with the same name */
+    /* Vectors of whole sectors starting on a sector boundary are sent to the card in a single multiple block write */
 
-    FRESULT res = f_open(&file, filename,  FA_CREATE_ALWAYS | FA_WRITE | FA_READ);
+    bool wholeSectors = contiguousFilePosition % AM_SD_CARD_SECTOR_SIZE == 0 && numberOfVectors <= AM_SD_CARD_MAXIMUM_VECTORS_IN_WRITE;
 
-    if (res != FR_OK) {
-        return false;
-    }
+    for (uint32_t i = 0; i < numberOfVectors; i += 1) wholeSectors &= vectors[i].numberOfBytes % AM_SD_CARD_SECTOR_SIZE == 0;
 
-    return true;
+    if (!wholeSectors) {
 
-}
+        for (uint32_t i = 0; i < numberOfVectors; i += 1) {
 
-bool AudioMoth_appendFile(char *filename) {
+            if (!writeToContiguousFile(vectors[i].bytes, vectors[i].numberOfBytes)) return false;
 
-    /* Open the file for writing. Append existing file with the same name */
+        }
 
-    FRESULT res = f_open(&file, filename,  FA_OPEN_ALWAYS | FA_WRITE | FA_READ);
+        return true;
 
-    if (res != FR_OK) {
-        return false;
     }
 
-    res = f_lseek(&file, f_size(&file));
+    DISKVEC segments[AM_SD_CARD_MAXIMUM_VECTORS_IN_WRITE];
 
-    if (res != FR_OK) {
-        f_close(&file);
-        return false;
-    }
+    uint32_t numberOfSectors = 0;
 
-    return true;
+    for (uint32_t i = 0; i < numberOfVectors; i += 1) {
 
-}
+        segments[i].buff = vectors[i].bytes;
 
-bool AudioMoth_openFileToRead(char *filename) {
+        segments[i].count = vectors[i].numberOfBytes / AM_SD_CARD_SECTOR_SIZE;
 
-    FRESULT res = f_open(&file, filename,  FA_READ);
+        numberOfSectors += segments[i].count;
 
-    if (res != FR_OK) {
-        return false;
     }
 
+    if (numberOfSectors == 0) return true;
+
+    uint32_t sector = contiguousFileSector + contiguousFilePosition / AM_SD_CARD_SECTOR_SIZE;
+
+    if (disk_writev(0, segments, numberOfVectors, sector) != RES_OK) return false;
+
+    contiguousFilePosition += numberOfSectors * AM_SD_CARD_SECTOR_SIZE;
+
     return true;
 
 }
 
-bool AudioMoth_readFile(char *buffer, uint32_t bufferSize) {
+static bool finishContiguousFile(void) {
 
-    FRESULT res = f_read(&file, buffer, bufferSize, &bw);
+    contiguousFile = false;
 
-    if (res != FR_OK) {
-        return false;
-    }
+    /* Write any partial sector */
 
-    return true;
+    uint32_t offset = contiguousFilePosition % AM_SD_CARD_SECTOR_SIZE;
 
-}
+    if (offset > 0) {
 
-bool AudioMoth_seekInFile(uint32_t position) {
+        uint32_t position = contiguousFilePosition;
 
-    FRESULT res = f_lseek(&file, position);
+        contiguousFilePosition -= offset;
+
+        if (!writeContiguousSectors(contiguousFilePartialSector, 1)) return false;
+
+        contiguousFilePosition = position;
 
-    if (res != FR_OK) {
-        return false;
     }
 
-    return true;
+    /* Hand the file back to the file system and release the unused clusters. The chain is known to be contiguous so the seek does not follow it from the start of the file */
 
-}
+    FRESULT res = f_lseekexpanded(&file, contiguousFilePosition);
 
-bool AudioMoth_writeToFile(void *bytes, uint16_t bytesToWrite) {
+    if (res != FR_OK) return false;
 
-    FRESULT res = f_write(&file, bytes, bytesToWrite, &bw);
+    res = f_truncate(&file);
 
-    if ((res != FR_OK) || (bytesToWrite != bw)) {
-        return false;
-    }
+    if (res != FR_OK) return false;
 
     return true;
 
 }
 
-bool AudioMoth_renameFile(char *originalFilename, char *newFilename) {
+/* Private functions to tune the SD card clock */
+
+static uint32_t getSDCardTransferSpeed(uint8_t *csd) {
+
+    static const uint8_t timeValuesInTenths[] = {0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+
+    /* The TRAN_SPEED field is a time value multiplied by a rate unit starting at 100 kbit/s */
+
+    uint8_t tranSpeed = csd[AM_SD_CARD_CSD_TRAN_SPEED];
+
+    uint32_t frequency = timeValuesInTenths[(tranSpeed >> 3) & 0x0F] * 10000;
+
+    uint32_t rateUnit = MIN(tranSpeed & 0x07, 3);
+
+    for (uint32_t i = 0; i < rateUnit; i += 1) frequency *= 10;
+
+    return frequency;
+
+}
+
+static uint32_t getSDCardIdentity(uint8_t *cid) {
+
+    uint32_t hash = 0;
+
+    for (uint32_t i = 0; i < AM_SD_CARD_REGISTER_LENGTH; i += 1) hash = hash * AM_SD_CARD_IDENTITY_MULTIPLIER + cid[i];
+
+    hash = (hash ^ (hash >> 16)) & 0xFFFF;
+
+    return hash == 0 ? 1 : hash;
+
+}
+
+static uint32_t findSDCardScratchSector(uint8_t *masterBootRecord) {
+
+    /* Use the unused sector before the first partition if the card has a master boot record rather than a bare volume */
+
+    if (masterBootRecord[AM_MBR_SIGNATURE_OFFSET] != 0x55 || masterBootRecord[AM_MBR_SIGNATURE_OFFSET + 1] != 0xAA) return 0;
+
+    if (masterBootRecord[0] == 0xEB || masterBootRecord[0] == 0xE9) return 0;
+
+    uint8_t *partition = masterBootRecord + AM_MBR_FIRST_PARTITION_OFFSET;
+
+    if (partition[0] != 0x00 && partition[0] != 0x80) return 0;
+
+    uint8_t *start = partition + AM_MBR_PARTITION_START_OFFSET;
+
+    uint32_t startSector = start[0] | (start[1] << 8) | (start[2] << 16) | (start[3] << 24);
+
+    return startSector > 1 ? startSector - 1 : 0;
+
+}
+
+static bool testSDCardClock(uint32_t scratchSector, uint8_t *reference, uint8_t *pattern, uint8_t *readBack) {
+
+    for (uint32_t repeat = 0; repeat < AM_SD_CARD_CLOCK_TEST_REPEATS; repeat += 1) {
+
+        if (scratchSector > 0) {
+
+            /* Write a pattern which toggles every data bit between adjacent bytes and read it back */
+
+            for (uint32_t i = 0; i < AM_SD_CARD_SECTOR_SIZE; i += 1) {
+
+                uint8_t value = i * AM_SD_CARD_CLOCK_TEST_MULTIPLIER + repeat;
+
+                pattern[i] = i & 1 ? ~value : value;
+
+            }
+
+            if (disk_write(0, pattern, scratchSector, 1) != RES_OK) return false;
+
+            if (disk_read(0, readBack, scratchSector, 1) != RES_OK) return false;
+
+            if (memcmp(pattern, readBack, AM_SD_CARD_SECTOR_SIZE) != 0) return false;
+
+        } else {
+
+            /* Without a scratch sector just check the first sector reads back unchanged */
+
+            if (disk_read(0, readBack, 0, 1) != RES_OK) return false;
+
+            if (memcmp(reference, readBack, AM_SD_CARD_SECTOR_SIZE) != 0) return false;
+
+        }
+
+    }
+
+    return true;
+
+}
+
+static void tuneSDCardClock(void) {
+
+    uint8_t csd[AM_SD_CARD_REGISTER_LENGTH];
+
+    uint8_t cid[AM_SD_CARD_REGISTER_LENGTH];
+
+    if (disk_ioctl(0, MMC_GET_CSD, csd) != RES_OK || disk_ioctl(0, MMC_GET_CID, cid) != RES_OK) return;
+
+    /* Reuse a previous calibration for the same card */
+
+    uint32_t identity = getSDCardIdentity(cid);
+
+    uint32_t setting = BURTC_RetRegGet(AM_BURTC_SD_CARD_CLOCK);
+
+    if (setting >> 16 == identity) {
+
+        MICROSD_SpiClkSet((setting & 0xFFFF) * HZ_IN_KHZ);
+
+        return;
+
+    }
+
+    /* The file system buffers are not in use before the volume is mounted */
+
+    uint8_t *reference = fatfs.win;
+
+    uint8_t *pattern = file.buf;
+
+    uint8_t *readBack = contiguousFilePartialSector;
+
+    if (disk_read(0, reference, 0, 1) != RES_OK) return;
+
+    uint32_t scratchSector = findSDCardScratchSector(reference);
+
+    if (scratchSector > 0 && disk_read(0, reference, scratchSector, 1) != RES_OK) return;
+
+    /* Step up through the USART clock dividers from the default clock to the card limit */
+
+    uint32_t defaultFrequency = MICROSD_SpiClkGet();
+
+    uint32_t peripheralFrequency = CMU_ClockFreqGet(cmuClock_HFPER);
+
+    uint32_t transferSpeed = getSDCardTransferSpeed(csd);
+
+    uint32_t bestFrequency = defaultFrequency;
+
+    bool limitFound = false;
+
+    for (uint32_t divider = peripheralFrequency / defaultFrequency / 2; divider > 0; divider -= 1) {
+
+        uint32_t frequency = peripheralFrequency / divider / 2;
+
+        if (frequency <= bestFrequency) continue;
+
+        if (frequency > transferSpeed) {
+
+            limitFound = true;
+
+            break;
+
+        }
+
+        MICROSD_SpiClkSet(frequency);
+
+        if (!testSDCardClock(scratchSector, reference, pattern, readBack)) {
+
+            limitFound = true;
+
+            break;
+
+        }
+
+        bestFrequency = MICROSD_SpiClkGet();
+
+    }
+
+    /* Restore the scratch sector at the default clock */
+
+    MICROSD_SpiClkSet(defaultFrequency);
+
+    if (scratchSector > 0) disk_write(0, reference, scratchSector, 1);
+
+    MICROSD_SpiClkSet(bestFrequency);
+
+    /* Keep the result if the card limit was found or every divider was tried at the full peripheral clock. A search run with the high frequency clock divided down stopped short of the fastest clocks so it is repeated at the next mount */
+
+    bool fullPeripheralClock = CMU_ClockDivGet(cmuClock_HF) == cmuClkDiv_1;
+
+    if (limitFound || fullPeripheralClock) BURTC_RetRegSet(AM_BURTC_SD_CARD_CLOCK, (identity << 16) | (bestFrequency / HZ_IN_KHZ));
+
+}
+
+/* Private function to read the volume serial number from the boot sector */
+
+static bool readVolumeSerialNumber(void) {
+
+    /* The contiguous file sector buffer is free as no file is open */
+
+    uint8_t *bootSector = contiguousFilePartialSector;
+
+    if (disk_read(0, bootSector, fatfs.volbase, 1) != RES_OK) return false;
+
+    uint32_t offset = fatfs.fs_type == FS_EXFAT ? AM_EXFAT_VOLUME_SERIAL_NUMBER_OFFSET : fatfs.fs_type == FS_FAT32 ? AM_FAT32_VOLUME_SERIAL_NUMBER_OFFSET : AM_FAT_VOLUME_SERIAL_NUMBER_OFFSET;
+
+    uint8_t *serialNumber = bootSector + offset;
+
+    volumeSerialNumber = serialNumber[0] | (serialNumber[1] << 8) | (serialNumber[2] << 16) | (serialNumber[3] << 24);
+
+    return true;
+
+}
+
+/* Mount the volume from parameters saved after a previous mount of the same card and volume */
+
+static bool mountFileSystemFromCache(AM_fileSystemCache_t *cache) {
+
+    /* Check the card is the same */
+
+    if (memcmp(sdCardIdentification, cache->cardIdentification, sizeof(sdCardIdentification)) != 0) return false;
+
+    /* Set up the file system without reading the partition table, FSInfo sector or allocation bitmap entry */
+
+    VOLPARAM volumeParameters;
+
+    memcpy(&volumeParameters, cache->volumeParameters, sizeof(VOLPARAM));
+
+    if (f_mountvolparam(&fatfs, "", &volumeParameters) != FR_OK) return false;
+
+    /* Check the card has not been reformatted by reading the boot sector alone */
+
+    if (!readVolumeSerialNumber() || volumeSerialNumber != cache->volumeSerialNumber) return false;
+
+    sdCardAllocationUnitSize = cache->allocationUnitSize;
+
+    return true;
+
+}
+
+/* Functions to handle file system */
+
+bool AudioMoth_enableFileSystem(AM_sdCardSpeed_t speed) {
+
+    return AudioMoth_enableFileSystemUsingCache(speed, NULL);
+
+}
+
+bool AudioMoth_enableFileSystemUsingCache(AM_sdCardSpeed_t speed, AM_fileSystemCache_t *cache) {
+
+    /* Check hardware version */
+
+    AM_hardwareVersion_t hardwareVersion = BURTC_RetRegGet(AM_BURTC_HARDWARE_VERSION);
+
+    if (hardwareVersion >= AM_VERSION_4) return false;
+
+    /* Turn SD card on */
+
+    GPIO_PinOutClear(SDEN_GPIOPORT, SD_ENABLE_N);
+
+    /* Initialise MicroSD driver */
+
+    if (speed == AM_SD_CARD_HIGH_SPEED) MICROSD_DoubleSpiClkFast();
+
+    MICROSD_Init();
+
+    /* Resume the SD card if it was kept powered and initialised, otherwise initialise it from scratch */
+
+    uint32_t startCounter = BURTC_CounterGet();
+
+    uint32_t sdCardState = BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE);
+
+    BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, sdCardState & AM_SD_CARD_STATE_INITIALISATION_TIME_MASK);
+
+    disk_ioctl(0, CTRL_INVALIDATE, NULL);
+
+    sdCardResumed = (sdCardState & AM_SD_CARD_STATE_POWERED) && disk_resume(0, sdCardState & AM_SD_CARD_STATE_TYPE_MASK) == 0;
+
+    DSTATUS resCard = sdCardResumed ? 0 : disk_initialize(0);
+
+    if (resCard == STA_NOINIT || resCard == STA_NODISK || resCard == STA_PROTECT) {
+        return false;
+    }
+
+    sdCardStartUpTime = ROUNDED_DIV((BURTC_CounterGet() - startCounter) * MILLISECONDS_IN_SECOND, AM_BURTC_TICKS_PER_SECOND);
+
+    /* Keep the initialisation time so the cost of a cold start is known when deciding whether to hold the card */
+
+    if (!sdCardResumed) BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, MIN(sdCardStartUpTime, UINT16_MAX) << AM_SD_CARD_STATE_INITIALISATION_TIME_SHIFT);
+
+    /* Step the SPI clock up to the fastest the card handles reliably */
+
+    if (speed == AM_SD_CARD_TUNED_SPEED) tuneSDCardClock();
+
+    /* Read the card identification which is used to check the cache */
+
+    if (disk_ioctl(0, MMC_GET_CID, sdCardIdentification) != RES_OK) memset(sdCardIdentification, 0, sizeof(sdCardIdentification));
+
+    /* Skip the full mount if the cached volume parameters are still valid */
+
+    if (cache != NULL && mountFileSystemFromCache(cache)) return true;
+
+    /* Read the allocation unit size from the SD status or the erase block size from the CSD */
+
+    DWORD numberOfSectors;
+
+    sdCardAllocationUnitSize = disk_ioctl(0, GET_BLOCK_SIZE, &numberOfSectors) == RES_OK ? numberOfSectors * AM_SD_CARD_SECTOR_SIZE : 0;
+
+    /* Initialise file system */
+
+    if (f_mount(&fatfs, "", 1) != FR_OK) {
+        return false;
+    }
+
+    /* Read the volume serial number used to check saved file system state belongs to this card */
+
+    if (!readVolumeSerialNumber()) {
+        return false;
+    }
+
+    /* Return success */
+
+    return true;
+
+}
+
+void AudioMoth_disableFileSystem(void) {
+
+    /* Check hardware version */
+
+    AM_hardwareVersion_t hardwareVersion = BURTC_RetRegGet(AM_BURTC_HARDWARE_VERSION);
+
+    if (hardwareVersion >= AM_VERSION_4) return;
+
+    /* Disable the SD card pins */
+
+    disk_ioctl(0, CTRL_INVALIDATE, NULL);
+
+    MICROSD_Deinit();
+
+    /* Turn SD card off*/
+
+    GPIO_PinOutSet(SDEN_GPIOPORT, SD_ENABLE_N);
+
+    BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE) & AM_SD_CARD_STATE_INITIALISATION_TIME_MASK);
+
+}
+
+void AudioMoth_keepSDCardPowered(void) {
+
+    /* Check hardware version */
+
+    AM_hardwareVersion_t hardwareVersion = BURTC_RetRegGet(AM_BURTC_HARDWARE_VERSION);
+
+    if (hardwareVersion >= AM_VERSION_4) return;
+
+    /* Record the type of a card initialised during this wake. A card held from an earlier wake keeps its recorded type */
+
+    uint32_t sdCardState = BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE);
+
+    BYTE cardType;
+
+    if (disk_ioctl(0, MMC_GET_TYPE, &cardType) == RES_OK) {
+
+        sdCardState = (sdCardState & AM_SD_CARD_STATE_INITIALISATION_TIME_MASK) | AM_SD_CARD_STATE_POWERED | cardType;
+
+        /* Release the pins from the USART so the card stays deselected with the clock low */
+
+        USART_Reset(MICROSD_USART);
+
+    }
+
+    if (sdCardState & AM_SD_CARD_STATE_POWERED) BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, sdCardState | AM_SD_CARD_STATE_HOLD);
+
+}
+
+uint32_t AudioMoth_getSDCardInitialisationTime(void) {
+
+    return (BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE) & AM_SD_CARD_STATE_INITIALISATION_TIME_MASK) >> AM_SD_CARD_STATE_INITIALISATION_TIME_SHIFT;
+
+}
+
+uint32_t AudioMoth_getSDCardStartUpTime(bool *resumed) {
+
+    if (resumed != NULL) *resumed = sdCardResumed;
+
+    return sdCardStartUpTime;
+
+}
+
+bool AudioMoth_getFileSystemCache(AM_fileSystemCache_t *cache) {
+
+    VOLPARAM volumeParameters;
+
+    if (f_getvolparam("", &volumeParameters) != FR_OK) {
+        return false;
+    }
+
+    memcpy(cache->cardIdentification, sdCardIdentification, sizeof(sdCardIdentification));
+
+    cache->volumeSerialNumber = volumeSerialNumber;
+
+    cache->allocationUnitSize = sdCardAllocationUnitSize;
+
+    memset(cache->volumeParameters, 0, sizeof(cache->volumeParameters));
+
+    memcpy(cache->volumeParameters, &volumeParameters, sizeof(VOLPARAM));
+
+    return true;
+
+}
+
+/* Format the SD card with the data area and clusters aligned to its allocation unit. The file system must be enabled */
+
+bool AudioMoth_formatFileSystem(void *workBuffer, uint32_t workBufferSize) {
+
+    DWORD numberOfSectors;
+
+    if (disk_ioctl(0, GET_SECTOR_COUNT, &numberOfSectors) != RES_OK) return false;
+
+    /* The erase and the file system writes can each take longer than the watch dog period on a large card, so it is stopped until the format completes */
+
+    bool watchdogEnabled = WDOG->CTRL & WDOG_CTRL_EN;
+
+    WDOG_Enable(false);
+
+    /* Erase the whole card first so every block starts pre-erased. Cards which cannot erase are still formatted */
+
+    DWORD eraseRange[2] = {0, numberOfSectors - 1};
+
+    disk_ioctl(0, CTRL_TRIM, eraseRange);
+
+    /* SDXC cards use exFAT and smaller cards FAT32, as in the SD specification. Clusters are no larger than the allocation unit */
+
+    bool exFAT = numberOfSectors > AM_SD_CARD_SDHC_MAXIMUM_SECTORS;
+
+    uint32_t clusterSize = exFAT ? AM_EXFAT_CLUSTER_SIZE : AM_FAT32_CLUSTER_SIZE;
+
+    if (sdCardAllocationUnitSize > 0) clusterSize = MIN(clusterSize, sdCardAllocationUnitSize);
+
+    /* The buffer is written in single calls to the disk driver so is limited to its largest write */
+
+    uint32_t length = MIN(workBufferSize, AM_SD_CARD_MAXIMUM_SECTORS_IN_WRITE * AM_SD_CARD_SECTOR_SIZE);
+
+    FRESULT res = f_mkfs("", exFAT ? FM_EXFAT : FM_FAT32, clusterSize, workBuffer, length);
+
+    /* Cards too small for FAT32 with these clusters fall back to the automatic choice */
+
+    if (res == FR_MKFS_ABORTED && !exFAT) res = f_mkfs("", FM_FAT | FM_FAT32, 0, workBuffer, length);
+
+    if (watchdogEnabled) {
+
+        WDOG_Feed();
+
+        WDOG_Enable(true);
+
+    }
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+uint32_t AudioMoth_getSDCardAllocationUnitSize(void) {
+
+    return sdCardAllocationUnitSize;
+
+}
+
+bool AudioMoth_doesFileExist(char *filename){
+
+    FRESULT res = f_stat(filename, NULL);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_openFile(char *filename) {
+
+    contiguousFile = false;
+
+    /* Open a file for writing. Overwrite existing file with the same name */
+
+    FRESULT res = f_open(&file, filename,  FA_CREATE_ALWAYS | FA_WRITE | FA_READ);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_appendFile(char *filename) {
+
+    contiguousFile = false;
+
+    /* Open the file for writing. Append existing file with the same name */
+
+    FRESULT res = f_open(&file, filename,  FA_OPEN_ALWAYS | FA_WRITE | FA_READ);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    res = f_lseek(&file, f_size(&file));
+
+    if (res != FR_OK) {
+        f_close(&file);
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_expandFile(uint32_t fileSize) {
+
+    /* Allocate a contiguous cluster chain for an empty file just opened for writing */
+
+    FRESULT res = f_expand(&file, fileSize, 1);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    /* Data is then written straight to the sectors of the chain without updating the file allocation table */
+
+    contiguousFile = true;
+
+    contiguousFileSize = fileSize;
+
+    contiguousFilePosition = 0;
+
+    contiguousFileSector = fatfs.database + fatfs.csize * (file.obj.sclust - AM_FAT_FIRST_DATA_CLUSTER);
+
+    return true;
+
+}
+
+bool AudioMoth_openFileToRead(char *filename) {
+
+    contiguousFile = false;
+
+    FRESULT res = f_open(&file, filename,  FA_READ);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_readFile(char *buffer, uint32_t bufferSize) {
+
+    FRESULT res = f_read(&file, buffer, bufferSize, &bw);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_seekInFile(uint32_t position) {
+
+    if (contiguousFile && !finishContiguousFile()) return false;
+
+    FRESULT res = f_lseek(&file, position);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_writeToFile(void *bytes, uint16_t bytesToWrite) {
+
+    if (contiguousFile) {
+
+        if (contiguousFilePosition + bytesToWrite <= contiguousFileSize) return writeToContiguousFile(bytes, bytesToWrite);
+
+        /* Fall back to the file system if the data will not fit in the allocated chain */
+
+        if (!finishContiguousFile()) return false;
+
+    }
+
+    FRESULT res = f_write(&file, bytes, bytesToWrite, &bw);
+
+    if ((res != FR_OK) || (bytesToWrite != bw)) {
+        return false;
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_writeToFileV(AM_fileVector_t *vectors, uint32_t numberOfVectors) {
+
+    if (contiguousFile) {
+
+        uint32_t bytesToWrite = 0;
+
+        for (uint32_t i = 0; i < numberOfVectors; i += 1) bytesToWrite += vectors[i].numberOfBytes;
+
+        if (contiguousFilePosition + bytesToWrite <= contiguousFileSize) return writeVectorsToContiguousFile(vectors, numberOfVectors);
+
+        /* Fall back to the file system if the data will not fit in the allocated chain */
+
+        if (!finishContiguousFile()) return false;
+
+    }
+
+    for (uint32_t i = 0; i < numberOfVectors; i += 1) {
+
+        FRESULT res = f_write(&file, vectors[i].bytes, vectors[i].numberOfBytes, &bw);
+
+        if ((res != FR_OK) || (vectors[i].numberOfBytes != bw)) {
+            return false;
+        }
+
+    }
+
+    return true;
+
+}
+
+bool AudioMoth_renameFile(char *originalFilename, char *newFilename) {
 
     FRESULT res = f_rename(originalFilename, newFilename);
 
@@ -2794,6 +3740,18 @@ bool AudioMoth_renameFile(char *originalFilename, char *newFilename) {
 
 }
 
+bool AudioMoth_deleteFile(char *filename) {
+
+    FRESULT res = f_unlink(filename);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
 bool AudioMoth_syncFile(void) {
 
     FRESULT res = f_sync(&file);
@@ -2808,6 +3766,11 @@ bool AudioMoth_syncFile(void) {
 
 bool AudioMoth_closeFile(void) {
 
+    if (contiguousFile && !finishContiguousFile()) {
+        f_close(&file);
+        return false;
+    }
+
     FRESULT res = f_close(&file);
 
     if (res != FR_OK) {
@@ -2842,6 +3805,86 @@ bool AudioMoth_makeDirectory(char *folderName) {
 
 }
 
+bool AudioMoth_changeDirectory(char *folderName) {
+
+    FRESULT res = f_chdir(folderName);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    return true;
+
+}
+
+/* Functions to save and restore the current directory across mounts */
+
+bool AudioMoth_getDirectoryLocation(AM_directoryLocation_t *location) {
+
+    location->volumeSerialNumber = volumeSerialNumber;
+
+    location->cluster = fatfs.cdir;
+    location->containingCluster = fatfs.cdc_scl;
+    location->containingSize = fatfs.cdc_size;
+    location->containingOffset = fatfs.cdc_ofs;
+
+    return true;
+
+}
+
+bool AudioMoth_setDirectoryLocation(AM_directoryLocation_t *location) {
+
+    /* Only restore a location saved from the same volume */
+
+    if (location->volumeSerialNumber != volumeSerialNumber) return false;
+
+    fatfs.cdir = location->cluster;
+    fatfs.cdc_scl = location->containingCluster;
+    fatfs.cdc_size = location->containingSize;
+    fatfs.cdc_ofs = location->containingOffset;
+
+    return true;
+
+}
+
+/* Functions to track the free space across mounts */
+
+bool AudioMoth_getFreeSpace(AM_freeSpace_t *freeSpace) {
+
+    /* This only counts the free clusters if the count is not already known */
+
+    FATFS *fs;
+
+    DWORD freeClusters;
+
+    FRESULT res = f_getfree("", &freeClusters, &fs);
+
+    if (res != FR_OK) {
+        return false;
+    }
+
+    freeSpace->volumeSerialNumber = volumeSerialNumber;
+
+    freeSpace->freeClusters = freeClusters;
+
+    freeSpace->clusterSize = fatfs.csize * AM_SD_CARD_SECTOR_SIZE;
+
+    return true;
+
+}
+
+bool AudioMoth_restoreFreeSpace(AM_freeSpace_t *freeSpace) {
+
+    /* Only restore a count saved from the same volume. The file system then keeps it up to date as clusters are allocated and released */
+
+    if (freeSpace->volumeSerialNumber != volumeSerialNumber || freeSpace->clusterSize != fatfs.csize * AM_SD_CARD_SECTOR_SIZE || freeSpace->freeClusters > fatfs.n_fatent - AM_FAT_FIRST_DATA_CLUSTER) return false;
+
+    fatfs.free_clst = freeSpace->freeClusters;
+
+    return true;
+
+}
+
 /* Functions to enable and disable EBI */
 
 static void enableEBI(void) {
@@ -2914,15 +3957,15 @@ static void enableEBI(void) {
 
     /* Read cycle times */
 
-    ebiInit.readStrobeCycles = 3;
-    ebiInit.readHoldCycles   = 1;
-    ebiInit.readSetupCycles  = 2;
+    ebiInit.readStrobeCycles = AM_EBI_READ_STROBE_CYCLES;
+    ebiInit.readHoldCycles   = AM_EBI_READ_HOLD_CYCLES;
+    ebiInit.readSetupCycles  = AM_EBI_READ_SETUP_CYCLES;
 
     /* Write cycle times */
 
-    ebiInit.writeStrobeCycles = 6;
-    ebiInit.writeHoldCycles   = 0;
-    ebiInit.writeSetupCycles  = 0;
+    ebiInit.writeStrobeCycles = AM_EBI_WRITE_STROBE_CYCLES;
+    ebiInit.writeHoldCycles   = AM_EBI_WRITE_HOLD_CYCLES;
+    ebiInit.writeSetupCycles  = AM_EBI_WRITE_SETUP_CYCLES;
 
     ebiInit.location = ebiLocation1;
 
@@ -2930,6 +3973,104 @@ static void enableEBI(void) {
 
     EBI_Init(&ebiInit);
 
+    /* Shorten the strobe times to the calibrated values */
+
+    calibrateEBI();
+
+}
+
+/* Functions to calibrate the EBI strobe times */
+
+static bool testEBITiming(void) {
+
+    volatile uint16_t *sram = (volatile uint16_t*)AM_EXTERNAL_SRAM_START_ADDRESS;
+
+    /* Write a pattern which toggles every data line between adjacent samples and read it back */
+
+    for (uint32_t i = 0; i < AM_EBI_CALIBRATION_SIZE_IN_SAMPLES; i += 1) {
+
+        uint16_t value = i * AM_EBI_CALIBRATION_MULTIPLIER;
+
+        sram[i] = i & 1 ? ~value : value;
+
+    }
+
+    for (uint32_t i = 0; i < AM_EBI_CALIBRATION_SIZE_IN_SAMPLES; i += 1) {
+
+        uint16_t value = i * AM_EBI_CALIBRATION_MULTIPLIER;
+
+        if (sram[i] != (uint16_t)(i & 1 ? ~value : value)) return false;
+
+    }
+
+    return true;
+
+}
+
+static void calibrateEBI(void) {
+
+    uint32_t clockFrequency = CMU_ClockFreqGet(cmuClock_EBI) / HZ_IN_MHZ;
+
+    /* Reuse a previous calibration if it was made at the same or a faster clock */
+
+    uint32_t timing = BURTC_RetRegGet(AM_BURTC_EBI_TIMING);
+
+    uint32_t calibratedClockFrequency = timing >> 16;
+
+    uint32_t readStrobeCycles = (timing >> 8) & 0xFF;
+
+    uint32_t writeStrobeCycles = timing & 0xFF;
+
+    if (readStrobeCycles == 0 || writeStrobeCycles == 0 || calibratedClockFrequency < clockFrequency) {
+
+        /* Find the shortest write strobe which works with the default read timing */
+
+        writeStrobeCycles = AM_EBI_WRITE_STROBE_CYCLES;
+
+        for (uint32_t cycles = 1; cycles < AM_EBI_WRITE_STROBE_CYCLES; cycles += 1) {
+
+            EBI_WriteTimingSet(AM_EBI_WRITE_SETUP_CYCLES, cycles, AM_EBI_WRITE_HOLD_CYCLES);
+
+            if (testEBITiming()) {
+
+                writeStrobeCycles = MIN(AM_EBI_WRITE_STROBE_CYCLES, cycles + AM_EBI_TIMING_MARGIN_CYCLES);
+
+                break;
+
+            }
+
+        }
+
+        EBI_WriteTimingSet(AM_EBI_WRITE_SETUP_CYCLES, writeStrobeCycles, AM_EBI_WRITE_HOLD_CYCLES);
+
+        /* Then find the shortest read strobe */
+
+        readStrobeCycles = AM_EBI_READ_STROBE_CYCLES;
+
+        for (uint32_t cycles = 1; cycles < AM_EBI_READ_STROBE_CYCLES; cycles += 1) {
+
+            EBI_ReadTimingSet(AM_EBI_READ_SETUP_CYCLES, cycles, AM_EBI_READ_HOLD_CYCLES);
+
+            if (testEBITiming()) {
+
+                readStrobeCycles = MIN(AM_EBI_READ_STROBE_CYCLES, cycles + AM_EBI_TIMING_MARGIN_CYCLES);
+
+                break;
+
+            }
+
+        }
+
+        BURTC_RetRegSet(AM_BURTC_EBI_TIMING, (clockFrequency << 16) | (readStrobeCycles << 8) | writeStrobeCycles);
+
+    }
+
+    /* Apply the calibrated timing */
+
+    EBI_WriteTimingSet(AM_EBI_WRITE_SETUP_CYCLES, writeStrobeCycles, AM_EBI_WRITE_HOLD_CYCLES);
+
+    EBI_ReadTimingSet(AM_EBI_READ_SETUP_CYCLES, readStrobeCycles, AM_EBI_READ_HOLD_CYCLES);
+
 }
 
 static void disableEBI(void) {
@@ -2989,6 +4130,14 @@ static void setupGPIO(void) {
 
     AM_hardwareVersion_t hardwareVersion = BURTC_RetRegGet(AM_BURTC_HARDWARE_VERSION);
 
+    /* Keep a held SD card powered and deselected, otherwise note that it is turned off */
+
+    uint32_t sdCardState = BURTC_RetRegGet(AM_BURTC_SD_CARD_STATE);
+
+    bool sdCardHeld = hardwareVersion < AM_VERSION_4 && (sdCardState & AM_SD_CARD_STATE_HOLD);
+
+    if (!sdCardHeld) BURTC_RetRegSet(AM_BURTC_SD_CARD_STATE, sdCardState & AM_SD_CARD_STATE_INITIALISATION_TIME_MASK);
+
 	/* GPIO A */
 
 	GPIO_PinModeSet(EBI_GPIOPORT_A, EBI_AD09, gpioModeDisabled, 0);
@@ -3019,10 +4168,18 @@ static void setupGPIO(void) {
 	GPIO_PinModeSet(EBI_GPIOPORT_B, EBI_A16, gpioModeDisabled, 0);
 	GPIO_PinModeSet(EBI_GPIOPORT_B, EBI_A17, gpioModeDisabled, 0);
 	GPIO_PinModeSet(gpioPortB, 2, gpioModeDisabled, 0);
-	GPIO_PinModeSet(gpioPortB, 3, gpioModeDisabled, 0);
-	GPIO_PinModeSet(gpioPortB, 4, gpioModeDisabled, 0);
-	GPIO_PinModeSet(gpioPortB, 5, gpioModeDisabled, 0);
-	GPIO_PinModeSet(gpioPortB, 6, gpioModeDisabled, 0);
+
+    if (sdCardHeld) {
+        GPIO_PinModeSet(MICROSD_GPIOPORT, MICROSD_MOSIPIN, gpioModePushPull, 1);
+        GPIO_PinModeSet(MICROSD_GPIOPORT, MICROSD_MISOPIN, gpioModeDisabled, 0);
+        GPIO_PinModeSet(MICROSD_GPIOPORT, MICROSD_CLKPIN, gpioModePushPull, 0);
+        GPIO_PinModeSet(MICROSD_GPIOPORT, MICROSD_CSPIN, gpioModePushPull, 1);
+    } else {
+	    GPIO_PinModeSet(gpioPortB, 3, gpioModeDisabled, 0);
+	    GPIO_PinModeSet(gpioPortB, 4, gpioModeDisabled, 0);
+	    GPIO_PinModeSet(gpioPortB, 5, gpioModeDisabled, 0);
+	    GPIO_PinModeSet(gpioPortB, 6, gpioModeDisabled, 0);
+    }
 
     if (hardwareVersion >= AM_VERSION_4) {
         GPIO_PinModeSet(gpioPortB, 7, gpioModeDisabled, 0);
@@ -3076,7 +4233,7 @@ static void setupGPIO(void) {
     if (hardwareVersion >= AM_VERSION_4) {
         GPIO_PinModeSet(SDEN_GPIOPORT, SD_ENABLE_N, gpioModeDisabled, 0);
     } else {
-	    GPIO_PinModeSet(SDEN_GPIOPORT, SD_ENABLE_N, gpioModePushPull, 1);
+	    GPIO_PinModeSet(SDEN_GPIOPORT, SD_ENABLE_N, gpioModePushPull, sdCardHeld ? 0 : 1);
     }
 
 	/* GPIO E */
@@ -3191,3 +4348,23 @@ void AudioMoth_setupSWOForPrint(void) {
     ITM->TER  = 0x1;
 
 }
+
+void AudioMoth_enableCycleCounter(void) {
+
+    /* Enable trace in core debug */
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+
+    /* Reset and start the cycle counter */
+
+    DWT->CYCCNT = 0;
+
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+}
+
+uint32_t AudioMoth_getCycleCount(void) {
+
+    return DWT->CYCCNT;
+
+}
@@ -0,0 +1,189 @@
+/****************************************************************************
+ * blockfile.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ramfunc.h"
+#include "blockfile.h"
+
+/* Block file constants */
+
+#define CRC_INITIAL_VALUE               0xFFFF
+
+#define CRC_POLYNOMIAL                  0x1021
+
+#define NUMBER_OF_BITS_IN_BYTE          8
+
+#define MAX(a, b)                       ((a) > (b) ? (a) : (b))
+
+/* CRC-16/CCITT look up table, filled on first use */
+
+static uint16_t crcTable[256];
+
+static bool crcTableInitialised;
+
+/* Private functions */
+
+static void initialiseCRCTable(void) {
+
+    for (uint32_t i = 0; i < 256; i += 1) {
+
+        uint16_t crc = i << NUMBER_OF_BITS_IN_BYTE;
+
+        for (uint32_t j = 0; j < NUMBER_OF_BITS_IN_BYTE; j += 1) crc = crc & 0x8000 ? (crc << 1) ^ CRC_POLYNOMIAL : crc << 1;
+
+        crcTable[i] = crc;
+
+    }
+
+    crcTableInitialised = true;
+
+}
+
+static BF_blockHeader_t* setBlockHeader(uint8_t *sector, BF_blockType_t type, uint32_t sequenceNumber, uint64_t sampleIndex, uint32_t numberOfSamples, uint32_t payloadSize, uint32_t timestamp, uint32_t milliseconds) {
+
+    memset(sector, 0, BF_SECTOR_SIZE);
+
+    BF_blockHeader_t *header = (BF_blockHeader_t*)sector;
+
+    header->magic = BF_BLOCK_MAGIC;
+    header->type = type;
+    header->sampleIndex = sampleIndex;
+    header->sequenceNumber = sequenceNumber;
+    header->timestamp = timestamp;
+    header->numberOfSamples = numberOfSamples;
+    header->payloadSize = payloadSize;
+    header->milliseconds = milliseconds;
+
+    return header;
+
+}
+
+/* Public functions */
+
+uint32_t BlockFile_getNumberOfPayloadSectors(BF_blockHeader_t *header) {
+
+    return (header->payloadSize + BF_SECTOR_SIZE - 1) / BF_SECTOR_SIZE;
+
+}
+
+AM_RAMFUNC uint16_t BlockFile_updateCRC(uint16_t crc, uint8_t *bytes, uint32_t numberOfBytes) {
+
+    if (!crcTableInitialised) initialiseCRCTable();
+
+    for (uint32_t i = 0; i < numberOfBytes; i += 1) crc = (crc << NUMBER_OF_BITS_IN_BYTE) ^ crcTable[(crc >> NUMBER_OF_BITS_IN_BYTE) ^ bytes[i]];
+
+    return crc;
+
+}
+
+void BlockFile_setFileHeader(uint8_t *sector, uint32_t timestamp, uint32_t milliseconds, BF_fileDescription_t *description) {
+
+    BF_blockHeader_t *header = setBlockHeader(sector, BF_FILE_HEADER, 0, 0, 0, 0, timestamp, milliseconds);
+
+    memcpy(sector + sizeof(BF_blockHeader_t), description, sizeof(BF_fileDescription_t));
+
+    header->crc = BlockFile_updateCRC(CRC_INITIAL_VALUE, sector, BF_SECTOR_SIZE);
+
+}
+
+void BlockFile_setSilenceBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, uint32_t numberOfSamples, uint32_t timestamp, uint32_t milliseconds) {
+
+    BF_blockHeader_t *header = setBlockHeader(sector, BF_SILENCE, sequenceNumber, sampleIndex, numberOfSamples, 0, timestamp, milliseconds);
+
+    header->crc = BlockFile_updateCRC(CRC_INITIAL_VALUE, sector, BF_SECTOR_SIZE);
+
+}
+
+/* The peak level and the CRC are found in a single pass over the samples as they are read from the external SRAM */
+
+AM_RAMFUNC void BlockFile_setAudioBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, int16_t *samples, uint32_t numberOfSamples, bool triggered, uint32_t timestamp, uint32_t milliseconds) {
+
+    if (!crcTableInitialised) initialiseCRCTable();
+
+    uint16_t crc = CRC_INITIAL_VALUE;
+
+    uint32_t peakLevel = 0;
+
+    for (uint32_t i = 0; i < numberOfSamples; i += 1) {
+
+        int32_t sample = samples[i];
+
+        peakLevel = MAX(peakLevel, (uint32_t)(sample < 0 ? -sample : sample));
+
+        crc = (crc << NUMBER_OF_BITS_IN_BYTE) ^ crcTable[(crc >> NUMBER_OF_BITS_IN_BYTE) ^ (sample & 0xFF)];
+
+        crc = (crc << NUMBER_OF_BITS_IN_BYTE) ^ crcTable[(crc >> NUMBER_OF_BITS_IN_BYTE) ^ ((sample >> NUMBER_OF_BITS_IN_BYTE) & 0xFF)];
+
+    }
+
+    BF_blockHeader_t *header = setBlockHeader(sector, BF_AUDIO, sequenceNumber, sampleIndex, numberOfSamples, numberOfSamples * sizeof(int16_t), timestamp, milliseconds);
+
+    header->flags = triggered ? BF_FLAG_TRIGGERED : 0;
+
+    header->peakLevel = peakLevel;
+
+    header->crc = BlockFile_updateCRC(crc, sector, BF_SECTOR_SIZE);
+
+}
+
+/* The payload is padded to whole sectors with whatever follows it in memory, which the CRC also covers */
+
+void BlockFile_setCompressedAudioBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, uint8_t *payload, uint32_t payloadSize, uint16_t *frameSizes, uint32_t numberOfFrames, uint32_t numberOfSamples, uint32_t peakLevel, bool triggered, uint32_t timestamp, uint32_t milliseconds) {
+
+    BF_blockHeader_t *header = setBlockHeader(sector, BF_COMPRESSED_AUDIO, sequenceNumber, sampleIndex, numberOfSamples, payloadSize, timestamp, milliseconds);
+
+    header->flags = triggered ? BF_FLAG_TRIGGERED : 0;
+
+    header->peakLevel = peakLevel;
+
+    memcpy(sector + sizeof(BF_blockHeader_t), frameSizes, numberOfFrames * sizeof(uint16_t));
+
+    uint16_t crc = BlockFile_updateCRC(CRC_INITIAL_VALUE, payload, BlockFile_getNumberOfPayloadSectors(header) * BF_SECTOR_SIZE);
+
+    header->crc = BlockFile_updateCRC(crc, sector, BF_SECTOR_SIZE);
+
+}
+
+/* The trailer payload is made up of whole sectors from separate buffers. Any padding after the payload size is covered by the CRC. A payload larger than the sectors supplied is refused */
+
+bool BlockFile_setTrailerBlock(uint8_t *sector, uint32_t sequenceNumber, uint64_t sampleIndex, uint8_t **payloadSectors, uint32_t numberOfPayloadSectors, uint32_t payloadSize, uint32_t timestamp, uint32_t milliseconds) {
+
+    if (payloadSize > numberOfPayloadSectors * BF_SECTOR_SIZE) return false;
+
+    BF_blockHeader_t *header = setBlockHeader(sector, BF_TRAILER, sequenceNumber, sampleIndex, 0, payloadSize, timestamp, milliseconds);
+
+    uint16_t crc = CRC_INITIAL_VALUE;
+
+    for (uint32_t i = 0; i < BlockFile_getNumberOfPayloadSectors(header); i += 1) crc = BlockFile_updateCRC(crc, payloadSectors[i], BF_SECTOR_SIZE);
+
+    header->crc = BlockFile_updateCRC(crc, sector, BF_SECTOR_SIZE);
+
+    return true;
+
+}
+
+bool BlockFile_isValidBlock(uint8_t *sector, uint8_t *payload) {
+
+    BF_blockHeader_t *header = (BF_blockHeader_t*)sector;
+
+    if (header->magic != BF_BLOCK_MAGIC || header->type > BF_COMPRESSED_AUDIO) return false;
+
+    uint16_t crc = header->crc;
+
+    header->crc = 0;
+
+    uint16_t calculatedCRC = BlockFile_updateCRC(CRC_INITIAL_VALUE, payload, BlockFile_getNumberOfPayloadSectors(header) * BF_SECTOR_SIZE);
+
+    calculatedCRC = BlockFile_updateCRC(calculatedCRC, sector, BF_SECTOR_SIZE);
+
+    header->crc = crc;
+
+    return crc == calculatedCRC;
+
+}
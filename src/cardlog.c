@@ -0,0 +1,173 @@
+/****************************************************************************
+ * cardlog.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "microsd.h"
+#include "audiomoth.h"
+#include "cardlog.h"
+
+/* Card log constants */
+
+#define MICROSECONDS_IN_MILLISECOND     1000
+
+#define SUMMARY_BUFFER_LENGTH           384
+
+#define RETURN_BOOL_ON_ERROR(fn) { \
+    bool success = (fn); \
+    if (success != true) { \
+        return success; \
+    } \
+}
+
+/* Summary buffer */
+
+static char summaryBuffer[SUMMARY_BUFFER_LENGTH];
+
+/* Statistics of the earlier files recorded since capture started. The driver statistics only cover the current file so the GUANO data stays per file */
+
+static MICROSD_Statistics_TypeDef earlierFileStatistics;
+
+/* Private functions */
+
+static uint32_t writeLatency(char *buffer, char *name, const MICROSD_Latency_TypeDef *latency) {
+
+    uint32_t mean = latency->count == 0 ? 0 : latency->total / latency->count;
+
+    uint32_t length = sprintf(buffer, "%-22s %10lu %10lu %10lu\n", name, latency->count, mean, latency->worst);
+
+    /* Histogram of measurements by upper bound in microseconds */
+
+    length += sprintf(buffer + length, "%-22s", "");
+
+    for (uint32_t i = 0; i < MICROSD_LATENCY_BINS; i += 1) {
+
+        if (latency->histogram[i] == 0) continue;
+
+        uint32_t bound = MICROSD_LATENCY_FIRST_BIN_US << (i == MICROSD_LATENCY_BINS - 1 ? i - 1 : i);
+
+        length += sprintf(buffer + length, " %s%lu:%lu", i == MICROSD_LATENCY_BINS - 1 ? ">=" : "<", bound, latency->histogram[i]);
+
+    }
+
+    length += sprintf(buffer + length, "\n");
+
+    return length;
+
+}
+
+static void addLatency(MICROSD_Latency_TypeDef *total, const MICROSD_Latency_TypeDef *latency) {
+
+    total->count += latency->count;
+
+    total->total += latency->total;
+
+    if (latency->worst > total->worst) total->worst = latency->worst;
+
+    for (uint32_t i = 0; i < MICROSD_LATENCY_BINS; i += 1) total->histogram[i] += latency->histogram[i];
+
+}
+
+static void addStatistics(MICROSD_Statistics_TypeDef *total, const MICROSD_Statistics_TypeDef *statistics) {
+
+    addLatency(&total->write, &statistics->write);
+
+    addLatency(&total->sector, &statistics->sector);
+
+    addLatency(&total->busy, &statistics->busy);
+
+    total->retries += statistics->retries;
+
+    total->errors += statistics->errors;
+
+}
+
+/* Public functions */
+
+void CardLog_reset(void) {
+
+    memset(&earlierFileStatistics, 0, sizeof(MICROSD_Statistics_TypeDef));
+
+    MICROSD_StatisticsReset();
+
+}
+
+void CardLog_startNextFile(void) {
+
+    addStatistics(&earlierFileStatistics, MICROSD_StatisticsGet());
+
+    MICROSD_StatisticsReset();
+
+}
+
+/* The field is left out if it does not fit in the space remaining in the buffer */
+
+uint32_t CardLog_writeGuanoData(char *buffer, uint32_t bufferSize) {
+
+    const MICROSD_Statistics_TypeDef *statistics = MICROSD_StatisticsGet();
+
+    if (statistics->write.count == 0 || bufferSize == 0) return 0;
+
+    uint32_t mean = statistics->write.total / statistics->write.count;
+
+    int length = snprintf(buffer, bufferSize, "\nOAD|SD Card Latency:%lu writes, mean %lu.%03lu ms, worst %lu.%03lu ms, worst busy %lu.%03lu ms, %lu retries", statistics->write.count, mean / MICROSECONDS_IN_MILLISECOND, mean % MICROSECONDS_IN_MILLISECOND, statistics->write.worst / MICROSECONDS_IN_MILLISECOND, statistics->write.worst % MICROSECONDS_IN_MILLISECOND, statistics->busy.worst / MICROSECONDS_IN_MILLISECOND, statistics->busy.worst % MICROSECONDS_IN_MILLISECOND, statistics->retries);
+
+    if (length < 0 || (uint32_t)length >= bufferSize) {
+
+        *buffer = 0;
+
+        return 0;
+
+    }
+
+    return length;
+
+}
+
+/* The summary covers every file recorded since capture started */
+
+bool CardLog_writeSummary(char *filename, char *recordingFilename, bool bufferOverflow) {
+
+    /* Take a copy as writing the log adds to the statistics */
+
+    MICROSD_Statistics_TypeDef statistics = earlierFileStatistics;
+
+    addStatistics(&statistics, MICROSD_StatisticsGet());
+
+    bool resumed;
+
+    uint32_t startUpTime = AudioMoth_getSDCardStartUpTime(&resumed);
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_appendFile(filename));
+
+    uint32_t length = sprintf(summaryBuffer, "%s - %lu retries, %lu errors, card %s in %lu ms%s\n", recordingFilename, statistics.retries, statistics.errors, resumed ? "resumed" : "initialised", startUpTime, bufferOverflow ? ", buffer overflow" : "");
+
+    length += sprintf(summaryBuffer + length, "%-22s %10s %10s %10s\n", "Latency (us)", "Count", "Mean", "Worst");
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(summaryBuffer, length));
+
+    length = writeLatency(summaryBuffer, "Write", &statistics.write);
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(summaryBuffer, length));
+
+    length = writeLatency(summaryBuffer, "Sector", &statistics.sector);
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(summaryBuffer, length));
+
+    length = writeLatency(summaryBuffer, "Busy wait", &statistics.busy);
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(summaryBuffer, length));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile("\n", 1));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_closeFile());
+
+    return true;
+
+}
@@ -190,9 +190,9 @@ DEFINE_FUNCTION_STEP(CP, 02, IS('0') || IS('1'), configSettings->enableLED = VAL
 DEFINE_FUNCTION_STRG(CP, 03, ",enableBatteryLevelDisplay:", INC_STATE)
 DEFINE_FUNCTION_STEP(CP, 04, IS('0') || IS('1'), configSettings->enableBatteryLevelDisplay = VALUE; INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_STRG(CP, 05, ",enableProprietaryFileFormat:", INC_STATE)
-DEFINE_FUNCTION_STEP(CP, 06, IS('0') || IS('1'), configSettings->enableProprietaryFileFormat = VALUE; INC_STATE; CLEAR_BUFFER)
+DEFINE_FUNCTION_STEP(CP, 06, IS('0') || IS('1') || IS('2'), configSettings->enableProprietaryFileFormat = VALUE; INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_STEP(CP, 07, IS(','), INC_STATE; CLEAR_BUFFER)
-DEFINE_FUNCTION_ELSE(CP, 08, IS('i'), INC_STATE; CLEAR_BUFFER, IS('s'), SET_STATE(19); CLEAR_BUFFER)
+DEFINE_FUNCTION_CND3(CP, 08, IS('i'), INC_STATE; CLEAR_BUFFER, IS('s'), SET_STATE(19); CLEAR_BUFFER, IS('e'), SET_STATE(64); CLEAR_BUFFER)
 DEFINE_FUNCTION_STRG(CP, 09, "nitialSleepRecordCycle", INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_ELSE(CP, 10, IS('s'), INC_STATE; CLEAR_BUFFER, IS(':'), SET_STATE(14); CLEAR_BUFFER)
 DEFINE_FUNCTION_STEP(CP, 11, IS(':'), INC_STATE)
@@ -224,7 +224,7 @@ DEFINE_FUNCTION_ELSE(CP, 36, ISDIGIT, ADD_TO_BUFFER, IS('}'), CHECK_BUFFER_MIN_M
 DEFINE_FUNCTION_ELSE(CP, 37, IS(',') && INDEX < (MAXIMUM_NUMBER_OF_START_STOP_PERIODS - 1), INC_INDEX; SET_STATE(32), IS(']'), configSettings->activeStartStopPeriods = INDEX + 1; if (checkStartStopPeriods(configSettings->startStopPeriods, configSettings->activeStartStopPeriods)) {INC_STATE} else {VALUE_ERROR})
 DEFINE_FUNCTION_STEP(CP, 38, IS('}'), SET_STATUS_SUCCESS)
 
-DEFINE_FUNCTION_STRG(CP, 39, "{gain:", INC_STATE)
+DEFINE_FUNCTION_STEP(CP, 39, IS('{'), SET_STATE(66); CLEAR_BUFFER)
 DEFINE_FUNCTION_STEP(CP, 40, IS('0') || IS('1') || IS('2') || IS('3') || IS('4'), configSettings->gain[INDEX] = VALUE; INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_STRG(CP, 41, ",sampleRate:", INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_ELSE(CP, 42, ISNUMBER, ADD_TO_BUFFER, IS(',') || (INDEX == 0 && IS('}')), bool success = handleSampleRate(BUFFER, &configSettings->sampleRate[INDEX], &configSettings->sampleRateDivider[INDEX]); if (!success) {VALUE_ERROR} else if (IS(',')) {INC_STATE} else {SET_STATE(RETURN)})
@@ -250,6 +250,15 @@ DEFINE_FUNCTION_STRG(CP, 61, "maximumT", INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_STRG(CP, 62, "otalFileSize:", INC_STATE; CLEAR_BUFFER)
 DEFINE_FUNCTION_ELSE(CP, 63, ISNUMBER, ADD_TO_BUFFER, IS('}'), CHECK_BUFFER_MIN_MAX_AND_SET(configSettings->maximumTotalOpportunisticFileSize, 0, 32768, SET_STATE(RETURN)))
 
+DEFINE_FUNCTION_STRG(CP, 64, "nableDailyFolders:", INC_STATE)
+DEFINE_FUNCTION_STEP(CP, 65, IS('0') || IS('1'), configSettings->enableDailyFolders = VALUE; SET_STATE(7); CLEAR_BUFFER)
+
+DEFINE_FUNCTION_ELSE(CP, 66, IS('g'), SET_STATE(70); CLEAR_BUFFER, IS('e'), INC_STATE; CLEAR_BUFFER)
+DEFINE_FUNCTION_STRG(CP, 67, "nableADPCM:", INC_STATE)
+DEFINE_FUNCTION_STEP(CP, 68, IS('0') || IS('1'), configSettings->enableADPCM[INDEX] = VALUE; INC_STATE; CLEAR_BUFFER)
+DEFINE_FUNCTION_STRG(CP, 69, ",g", INC_STATE; CLEAR_BUFFER)
+DEFINE_FUNCTION_STRG(CP, 70, "ain:", SET_STATE(40))
+
 static void (*CPfunctions[])(char, CP_parserState_t*, CP_configSettings_t*) = {CP00, CP01, CP02, CP03, CP04, CP05, CP06, CP07, \
                                                                                CP08, CP09, CP10, CP11, CP12, CP13, CP14, CP15, \
                                                                                CP16, CP17, CP18, CP19, CP20, CP21, CP22, CP23, \
@@ -257,7 +266,8 @@ static void (*CPfunctions[])(char, CP_parserState_t*, CP_configSettings_t*) = {C
                                                                                CP32, CP33, CP34, CP35, CP36, CP37, CP38, CP39, \
                                                                                CP40, CP41, CP42, CP43, CP44, CP45, CP46, CP47, \
                                                                                CP48, CP49, CP50, CP51, CP52, CP53, CP54, CP55, \
-                                                                               CP56, CP57, CP58, CP59, CP60, CP61, CP62, CP63 };
+                                                                               CP56, CP57, CP58, CP59, CP60, CP61, CP62, CP63, \
+                                                                               CP64, CP65, CP66, CP67, CP68, CP69, CP70 };
 
 /* Define parser */
 
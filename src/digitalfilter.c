@@ -10,6 +10,7 @@
 #include <complex.h>
 
 #include "digitalfilter.h"
+#include "ramfunc.h"
 
 /*  Useful macros */
 
@@ -162,7 +163,7 @@ static inline void writeFilteredOutput(int16_t *dest, uint32_t index, float filt
 
 /* General filter routine */
 
-static bool filter(int16_t *source, int16_t *dest, uint32_t sampleRateDivider, uint32_t size, uint16_t amplitudeThreshold) {
+AM_RAMFUNC static bool filter(int16_t *source, int16_t *dest, uint32_t sampleRateDivider, uint32_t size, uint16_t amplitudeThreshold) {
 
     uint32_t index = 0;
 
@@ -202,7 +203,7 @@ static bool filter(int16_t *source, int16_t *dest, uint32_t sampleRateDivider, u
 
 /* Fast filter routing for 256khz and 384kHz */
 
-static bool fastFilter(int16_t *source, int16_t *dest, uint32_t size, uint16_t amplitudeThreshold) {
+AM_RAMFUNC static bool fastFilter(int16_t *source, int16_t *dest, uint32_t size, uint16_t amplitudeThreshold) {
 
     bool exceededAmplitudeThreshold = false;
 
@@ -260,7 +261,7 @@ void DigitalFilter_applyAdditionalGain(float g) {
 
 /* Apply digital filter */
 
-bool DigitalFilter_filter(int16_t *source, int16_t *dest, uint32_t sampleRateDivider, uint32_t size, uint16_t amplitudeThreshold) {
+AM_RAMFUNC bool DigitalFilter_filter(int16_t *source, int16_t *dest, uint32_t sampleRateDivider, uint32_t size, uint16_t amplitudeThreshold) {
 
     if (sampleRateDivider == 1) {
 
@@ -0,0 +1,370 @@
+/****************************************************************************
+ * lossless.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ramfunc.h"
+#include "lossless.h"
+
+/* Encoder constants */
+
+#define NUMBER_OF_BYTES_IN_SAMPLE               2
+
+#define NUMBER_OF_BITS_IN_BYTE                  8
+
+#define RICE_PARAMETER_BITS                     5
+
+#define MAXIMUM_RICE_PARAMETER                  20
+
+#define MAXIMUM_UNARY_BITS                      16
+
+#define MIN(a, b)                               ((a) < (b) ? (a) : (b))
+
+#define MAX(a, b)                               ((a) > (b) ? (a) : (b))
+
+/* Bit stream structure */
+
+typedef struct {
+    uint8_t *bytes;
+    uint32_t position;
+    uint32_t limit;
+    uint32_t accumulator;
+    uint32_t numberOfBits;
+    bool overflow;
+} bitStream_t;
+
+/* Each frame is encoded here and only copied back over the samples if it is smaller than them */
+
+static uint8_t frameBuffer[NUMBER_OF_BYTES_IN_SAMPLE * LL_FRAME_SIZE];
+
+/* Bit stream functions */
+
+static inline void writeBits(bitStream_t *stream, uint32_t value, uint32_t numberOfBits) {
+
+    stream->accumulator = (stream->accumulator << numberOfBits) | value;
+
+    stream->numberOfBits += numberOfBits;
+
+    while (stream->numberOfBits >= NUMBER_OF_BITS_IN_BYTE) {
+
+        stream->numberOfBits -= NUMBER_OF_BITS_IN_BYTE;
+
+        if (stream->position == stream->limit) {
+
+            stream->overflow = true;
+
+            return;
+
+        }
+
+        stream->bytes[stream->position++] = stream->accumulator >> stream->numberOfBits;
+
+    }
+
+}
+
+static inline void flushBits(bitStream_t *stream) {
+
+    if (stream->numberOfBits > 0) writeBits(stream, 0, NUMBER_OF_BITS_IN_BYTE - stream->numberOfBits);
+
+}
+
+static inline uint32_t readBits(bitStream_t *stream, uint32_t numberOfBits) {
+
+    while (stream->numberOfBits < numberOfBits) {
+
+        if (stream->position == stream->limit) {
+
+            stream->overflow = true;
+
+            return 0;
+
+        }
+
+        stream->accumulator = (stream->accumulator << NUMBER_OF_BITS_IN_BYTE) | stream->bytes[stream->position++];
+
+        stream->numberOfBits += NUMBER_OF_BITS_IN_BYTE;
+
+    }
+
+    stream->numberOfBits -= numberOfBits;
+
+    return (stream->accumulator >> stream->numberOfBits) & ((1 << numberOfBits) - 1);
+
+}
+
+/* Fixed predictor functions */
+
+static inline int32_t getResidual(int16_t *samples, uint32_t index, uint32_t order) {
+
+    int16_t *x = samples + index;
+
+    switch (order) {
+
+        case 1:
+            return x[0] - x[-1];
+
+        case 2:
+            return x[0] - 2 * x[-1] + x[-2];
+
+        case 3:
+            return x[0] - 3 * x[-1] + 3 * x[-2] - x[-3];
+
+        case 4:
+            return x[0] - 4 * x[-1] + 6 * x[-2] - 4 * x[-3] + x[-4];
+
+        default:
+            return x[0];
+
+    }
+
+}
+
+/* Choose the predictor order with the smallest sum of absolute residuals, found from successive differences in a single pass as FLAC does */
+
+static uint32_t chooseOrder(int16_t *samples, uint32_t numberOfSamples, uint32_t *peakLevel) {
+
+    uint32_t sums[LL_MAXIMUM_ORDER + 1] = {0};
+
+    int32_t previous[LL_MAXIMUM_ORDER] = {0};
+
+    for (uint32_t i = 0; i < numberOfSamples; i += 1) {
+
+        int32_t difference = samples[i];
+
+        *peakLevel = MAX(*peakLevel, (uint32_t)(difference < 0 ? -difference : difference));
+
+        for (uint32_t j = 0; j <= LL_MAXIMUM_ORDER; j += 1) {
+
+            if (i >= LL_MAXIMUM_ORDER) sums[j] += difference < 0 ? -difference : difference;
+
+            if (j == LL_MAXIMUM_ORDER) break;
+
+            int32_t next = difference - previous[j];
+
+            previous[j] = difference;
+
+            difference = next;
+
+        }
+
+    }
+
+    if (numberOfSamples <= LL_MAXIMUM_ORDER) return 0;
+
+    uint32_t order = 0;
+
+    for (uint32_t j = 1; j <= LL_MAXIMUM_ORDER; j += 1) {
+
+        if (sums[j] < sums[order]) order = j;
+
+    }
+
+    return order;
+
+}
+
+/* Encode a frame into the frame buffer. Returns zero if the result is no smaller than the samples */
+
+static uint32_t encodeFrame(int16_t *samples, uint32_t numberOfSamples, uint32_t order) {
+
+    bitStream_t stream = {.bytes = frameBuffer, .limit = NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamples - 1};
+
+    writeBits(&stream, order, NUMBER_OF_BITS_IN_BYTE);
+
+    for (uint32_t i = 0; i < order; i += 1) {
+
+        uint16_t sample = samples[i];
+
+        writeBits(&stream, sample & 0xFF, NUMBER_OF_BITS_IN_BYTE);
+
+        writeBits(&stream, sample >> NUMBER_OF_BITS_IN_BYTE, NUMBER_OF_BITS_IN_BYTE);
+
+    }
+
+    for (uint32_t start = 0; start < numberOfSamples && !stream.overflow; start += LL_PARTITION_SIZE) {
+
+        uint32_t first = MAX(start, order);
+
+        uint32_t last = MIN(start + LL_PARTITION_SIZE, numberOfSamples);
+
+        /* Choose the Rice parameter from the mean of the mapped residuals */
+
+        uint32_t sum = 0;
+
+        for (uint32_t i = first; i < last; i += 1) {
+
+            int32_t residual = getResidual(samples, i, order);
+
+            sum += (residual << 1) ^ (residual >> 31);
+
+        }
+
+        uint32_t k = 0;
+
+        while (k < MAXIMUM_RICE_PARAMETER && ((uint64_t)(last - first) << (k + 1)) < sum) k += 1;
+
+        writeBits(&stream, k, RICE_PARAMETER_BITS);
+
+        for (uint32_t i = first; i < last && !stream.overflow; i += 1) {
+
+            int32_t residual = getResidual(samples, i, order);
+
+            uint32_t value = (residual << 1) ^ (residual >> 31);
+
+            uint32_t quotient = value >> k;
+
+            while (quotient >= MAXIMUM_UNARY_BITS && !stream.overflow) {
+
+                writeBits(&stream, 0, MAXIMUM_UNARY_BITS);
+
+                quotient -= MAXIMUM_UNARY_BITS;
+
+            }
+
+            writeBits(&stream, 1, quotient + 1);
+
+            if (k > 0) writeBits(&stream, value & ((1 << k) - 1), k);
+
+        }
+
+    }
+
+    flushBits(&stream);
+
+    return stream.overflow ? 0 : stream.position;
+
+}
+
+static bool decodeFrame(uint8_t *bytes, uint32_t numberOfBytes, int16_t *samples, uint32_t numberOfSamples) {
+
+    bitStream_t stream = {.bytes = bytes, .limit = numberOfBytes};
+
+    uint32_t order = readBits(&stream, NUMBER_OF_BITS_IN_BYTE);
+
+    if (order > LL_MAXIMUM_ORDER || order > numberOfSamples) return false;
+
+    for (uint32_t i = 0; i < order; i += 1) {
+
+        uint16_t sample = readBits(&stream, NUMBER_OF_BITS_IN_BYTE);
+
+        sample |= readBits(&stream, NUMBER_OF_BITS_IN_BYTE) << NUMBER_OF_BITS_IN_BYTE;
+
+        samples[i] = sample;
+
+    }
+
+    for (uint32_t start = 0; start < numberOfSamples && !stream.overflow; start += LL_PARTITION_SIZE) {
+
+        uint32_t first = MAX(start, order);
+
+        uint32_t last = MIN(start + LL_PARTITION_SIZE, numberOfSamples);
+
+        uint32_t k = readBits(&stream, RICE_PARAMETER_BITS);
+
+        if (k > MAXIMUM_RICE_PARAMETER) return false;
+
+        for (uint32_t i = first; i < last && !stream.overflow; i += 1) {
+
+            uint32_t quotient = 0;
+
+            while (readBits(&stream, 1) == 0 && !stream.overflow) quotient += 1;
+
+            uint32_t value = (quotient << k) | (k > 0 ? readBits(&stream, k) : 0);
+
+            int32_t residual = (value >> 1) ^ -(int32_t)(value & 1);
+
+            /* The residual of a zero sample is the negated prediction */
+
+            samples[i] = 0;
+
+            samples[i] = residual - getResidual(samples, i, order);
+
+        }
+
+    }
+
+    return !stream.overflow;
+
+}
+
+/* Public functions */
+
+uint32_t Lossless_getNumberOfFrames(uint32_t numberOfSamples) {
+
+    return (numberOfSamples + LL_FRAME_SIZE - 1) / LL_FRAME_SIZE;
+
+}
+
+/* Frames are written back over the samples. A frame is never larger than its samples so the output never overtakes the input */
+
+AM_RAMFUNC uint32_t Lossless_encode(int16_t *samples, uint32_t numberOfSamples, uint16_t *frameSizes, uint32_t *peakLevel) {
+
+    uint8_t *output = (uint8_t*)samples;
+
+    uint32_t numberOfBytes = 0;
+
+    *peakLevel = 0;
+
+    for (uint32_t i = 0; i < Lossless_getNumberOfFrames(numberOfSamples); i += 1) {
+
+        int16_t *frame = samples + i * LL_FRAME_SIZE;
+
+        uint32_t numberOfSamplesInFrame = MIN(LL_FRAME_SIZE, numberOfSamples - i * LL_FRAME_SIZE);
+
+        uint32_t order = chooseOrder(frame, numberOfSamplesInFrame, peakLevel);
+
+        uint32_t frameSize = encodeFrame(frame, numberOfSamplesInFrame, order);
+
+        if (frameSize > 0) {
+
+            memcpy(output + numberOfBytes, frameBuffer, frameSize);
+
+        } else {
+
+            frameSize = NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesInFrame;
+
+            memmove(output + numberOfBytes, frame, frameSize);
+
+        }
+
+        frameSizes[i] = frameSize;
+
+        numberOfBytes += frameSize;
+
+    }
+
+    return numberOfBytes;
+
+}
+
+bool Lossless_decode(uint8_t *bytes, uint16_t *frameSizes, int16_t *samples, uint32_t numberOfSamples) {
+
+    for (uint32_t i = 0; i < Lossless_getNumberOfFrames(numberOfSamples); i += 1) {
+
+        int16_t *frame = samples + i * LL_FRAME_SIZE;
+
+        uint32_t numberOfSamplesInFrame = MIN(LL_FRAME_SIZE, numberOfSamples - i * LL_FRAME_SIZE);
+
+        if (frameSizes[i] == NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesInFrame) {
+
+            memcpy(frame, bytes, frameSizes[i]);
+
+        } else if (!decodeFrame(bytes, frameSizes[i], frame, numberOfSamplesInFrame)) {
+
+            return false;
+
+        }
+
+        bytes += frameSizes[i];
+
+    }
+
+    return true;
+
+}
@@ -7,6 +7,7 @@
 #include <time.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
@@ -15,6 +16,14 @@
 #include "audioconfig.h"
 #include "configparser.h"
 #include "digitalfilter.h"
+#include "adctuner.h"
+#include "profiler.h"
+#include "cardlog.h"
+#include "sdtest.h"
+#include "blockfile.h"
+#include "lossless.h"
+#include "adpcm.h"
+#include "ramfunc.h"
 
 /* Useful time constants */
 
@@ -53,13 +62,62 @@
 #define EXTERNAL_SRAM_SIZE_IN_SAMPLES                   (AM_EXTERNAL_SRAM_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE)
 #define NUMBER_OF_SAMPLES_IN_BUFFER                     (EXTERNAL_SRAM_SIZE_IN_SAMPLES / NUMBER_OF_BUFFERS)
 
-/* DMA transfer constant */
+/* DMA transfer constants */
 
 #define MAXIMUM_SAMPLES_IN_DMA_TRANSFER                 1024
 
-/* Microphone warm-up constant */
+/* Chained DMA descriptors are only used in a build made with 'make CHAINED_DMA=1' */
+
+#ifdef AM_ENABLE_CHAINED_DMA
+#define SAMPLES_IN_RAW_CAPTURE_DMA_TRANSFER             (NUMBER_OF_SAMPLES_IN_BUFFER / 2)
+#endif
+
+/* Microphone warm-up constants. The warm-up ends once the output has settled and is never longer than half a second */
 
 #define FRACTION_OF_SECOND_FOR_WARMUP                   2
+#define FRACTION_OF_SECOND_FOR_MINIMUM_WARMUP           32
+#define WARMUP_SETTLED_TRANSFERS                        2
+#define WARMUP_VARIANCE_RATIO                           2
+#define WARMUP_MEAN_CHANGE_RATIO                        4
+
+/* ADC calibration constants */
+
+#define ADC_TUNE_FILENAME                               "ADCTUNE.TXT"
+#define ADC_TUNE_RESULT_FILENAME                        "ADCTUNE-RESULT.TXT"
+#define FRACTION_OF_SECOND_FOR_CALIBRATION              4
+#define NOISE_MULTIPLIER                                100
+
+/* SD card test constants */
+
+#define SD_TEST_FILENAME                                "SDTEST.TXT"
+#define SD_TEST_RESULT_FILENAME                         "SDTEST-RESULT.TXT"
+#define SD_TEST_DATA_FILENAME                           "SDTEST.WAV"
+#define SD_TEST_RESULT_BUFFER_LENGTH                    1024
+
+/* SD card format constants */
+
+#define FORMAT_FILENAME                                 "FORMAT.TXT"
+#define USB_FORMAT_SD_CARD_COMMAND                      0x01
+
+/* Daily folder constants */
+
+#define DAILY_FOLDER_NAME_LENGTH                        16
+#define DATE_YEAR_MULTIPLIER                            10000
+#define DATE_MONTH_MULTIPLIER                           100
+
+/* Free space constant */
+
+#define FREE_SPACE_RESERVED_CLUSTERS                    4
+
+/* SD card power hold constants. Holding the card costs its idle current for the whole sleep while a cold start costs the initialisation current for the measured initialisation time. The two currents are typical datasheet figures and have not been measured on the device */
+
+#define SD_CARD_INITIALISATION_CURRENT_IN_UA            30000
+#define SD_CARD_IDLE_CURRENT_IN_UA                      300
+#define MAXIMUM_SD_CARD_POWER_HOLD_INTERVAL             60
+
+/* SD card log constant */
+
+#define CARD_LOG_FILENAME                               "CARDLOG.TXT"
 
 /* Compression constants */
 
@@ -69,12 +127,28 @@
 
 #define MAXIMUM_WAV_FILE_SIZE                          (UINT32_MAX - 1)
 
+/* File allocation constant. A file opened while the microphone is running only allocates this much in advance so the ring can absorb the file allocation table writes */
+
+#define MAXIMUM_PREALLOCATION_WHILE_CAPTURING          (8 * NUMBER_OF_BYTES_IN_ONE_MB)
+
+/* Block file constants. A buffer may need an audio block header, a silence block and a further header where a write unit boundary splits it */
+
+#define BLOCK_FILE_SECTORS_PER_BUFFER                   3
+#define BLOCK_FILE_TRAILER_SECTORS                      3
+#define BLOCK_FILE_BUFFER_OVERHEAD_IN_BYTES             (BLOCK_FILE_SECTORS_PER_BUFFER * BF_SECTOR_SIZE)
+#define BLOCK_FILE_OVERHEAD_IN_BYTES                    (BLOCK_FILE_TRAILER_SECTORS * BF_SECTOR_SIZE + 2 * BLOCK_FILE_BUFFER_OVERHEAD_IN_BYTES)
+
+/* A value of 2 for enableProprietaryFileFormat selects block files with losslessly compressed audio blocks */
+
+#define LOSSLESS_BLOCK_FILE_FORMAT                      2
+
 /* WAV header constant */
 
 #define PCM_FORMAT                                      1
 #define RIFF_ID_LENGTH                                  4
 #define LENGTH_OF_ARTIST                                32
 #define LENGTH_OF_COMMENT                               384
+#define LENGTH_OF_PADDING                               16
 
 /* USB configuration constant */
 
@@ -127,6 +201,16 @@
 
 #define INITIAL_AND_STANDARD_SLEEP_RECORD_CYCLES        2
 
+/* Core clock governor constants */
+
+#define GOVERNOR_EVALUATION_PERIOD_IN_MILLISECONDS      2000
+#define GOVERNOR_MAXIMUM_DUTY_CYCLE_PERCENTAGE          40
+#define GOVERNOR_MAXIMUM_CORE_CLOCK_DIVIDER             4
+#define GOVERNOR_RING_OCCUPANCY_LIMIT                   (NUMBER_OF_BUFFERS / 2)
+
+#define MILLISECONDS_IN_SECOND                          1000
+#define PERCENTAGE_MULTIPLIER                           100
+
 /* Location constants */
 
 #define ACOUSTIC_LONGITUDE_MULTIPLIER                   2
@@ -173,9 +257,11 @@
 
 #define ROUNDED_DIV(a, b)                       (((a) + (b/2)) / (b))
 
+#define ROUND_UP_TO_MULTIPLE(a, b)              (((a) + (b) - 1) / (b) * (b))
+
 /* Recording state enumeration */
 
-typedef enum {RECORDING_OKAY, TOTAL_FILE_SIZE_LIMITED, FILE_SIZE_LIMITED, SUPPLY_VOLTAGE_LOW, SWITCH_CHANGED, SDCARD_WRITE_ERROR} AM_recordingState_t;
+typedef enum {RECORDING_OKAY, TOTAL_FILE_SIZE_LIMITED, FILE_SIZE_LIMITED, SUPPLY_VOLTAGE_LOW, SWITCH_CHANGED, SDCARD_WRITE_ERROR, SDCARD_FULL, BUFFER_OVERFLOW} AM_recordingState_t;
 
 /* Filter type enumeration */
 
@@ -198,7 +284,7 @@ typedef struct {
 
 #pragma pack(pop)
 
-/* WAV header */
+/* WAV header. The JUNK chunk pads the header to a single SD card sector so the audio data starts on a sector boundary */
 
 #pragma pack(push, 1)
 
@@ -217,6 +303,11 @@ typedef struct {
     char artist[LENGTH_OF_ARTIST];
 } iart_t;
 
+typedef struct {
+    chunk_t junk;
+    char padding[LENGTH_OF_PADDING];
+} junk_t;
+
 typedef struct {
     uint16_t format;
     uint16_t numberOfChannels;
@@ -235,9 +326,33 @@ typedef struct {
     char info[RIFF_ID_LENGTH];
     icmt_t icmt;
     iart_t iart;
+    junk_t junk;
     chunk_t data;
 } wavHeader_t;
 
+/* IMA-ADPCM WAV header. The extended format and fact chunks take the space of the JUNK padding so the header still fills a single sector */
+
+typedef struct {
+    wavFormat_t wavFormat;
+    uint16_t extraSize;
+    uint16_t samplesPerBlock;
+} adpcmFormat_t;
+
+typedef struct {
+    chunk_t riff;
+    char format[RIFF_ID_LENGTH];
+    chunk_t fmt;
+    adpcmFormat_t adpcmFormat;
+    chunk_t fact;
+    uint32_t numberOfSamples;
+    chunk_t list;
+    char info[RIFF_ID_LENGTH];
+    icmt_t icmt;
+    iart_t iart;
+    chunk_t junk;
+    chunk_t data;
+} adpcmWavHeader_t;
+
 #pragma pack(pop)
 
 static wavHeader_t wavHeader = {
@@ -249,6 +364,26 @@ static wavHeader_t wavHeader = {
     .info = "INFO",
     .icmt = {.icmt.id = "ICMT", .icmt.size = LENGTH_OF_COMMENT, .comment = ""},
     .iart = {.iart.id = "IART", .iart.size = LENGTH_OF_ARTIST, .artist = ""},
+    .junk = {.junk.id = "JUNK", .junk.size = LENGTH_OF_PADDING, .padding = ""},
+    .data = {.id = "data", .size = 0}
+};
+
+static adpcmWavHeader_t adpcmWavHeader = {
+    .riff = {.id = "RIFF", .size = 0},
+    .format = "WAVE",
+    .fmt = {.id = "fmt ", .size = sizeof(adpcmFormat_t)},
+    .adpcmFormat = {
+        .wavFormat = {.format = ADPCM_FORMAT, .numberOfChannels = 1, .samplesPerSecond = 0, .bytesPerSecond = 0, .bytesPerCapture = ADPCM_BLOCK_SIZE, .bitsPerSample = ADPCM_BITS_PER_SAMPLE},
+        .extraSize = sizeof(uint16_t),
+        .samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK
+    },
+    .fact = {.id = "fact", .size = sizeof(uint32_t)},
+    .numberOfSamples = 0,
+    .list = {.id = "LIST", .size = RIFF_ID_LENGTH + sizeof(icmt_t) + sizeof(iart_t)},
+    .info = "INFO",
+    .icmt = {.icmt.id = "ICMT", .icmt.size = LENGTH_OF_COMMENT, .comment = ""},
+    .iart = {.iart.id = "IART", .iart.size = LENGTH_OF_ARTIST, .artist = ""},
+    .junk = {.id = "JUNK", .size = 0},
     .data = {.id = "data", .size = 0}
 };
 
@@ -263,7 +398,22 @@ static void setHeaderDetails(wavHeader_t *wavHeader, uint32_t sampleRate, uint32
 
 }
 
-static void setHeaderComment(wavHeader_t *wavHeader, uint32_t currentTime, int8_t timezoneHours, int8_t timezoneMinutes, uint8_t *serialNumber, uint32_t gain, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature, bool switchPositionChanged, bool supplyVoltageLow, bool fileSizeLimited, bool totalFileSizeLimited, uint32_t amplitudeThreshold, AM_filterType_t filterType, uint32_t lowerFilterFreq, uint32_t higherFilterFreq) {
+/* The ADPCM header takes its comment and artist from the PCM header */
+
+static void setADPCMHeaderDetails(adpcmWavHeader_t *adpcmWavHeader, wavHeader_t *wavHeader, uint32_t sampleRate, uint32_t numberOfSamples, uint32_t guanoHeaderSize) {
+
+    adpcmWavHeader->adpcmFormat.wavFormat.samplesPerSecond = sampleRate;
+    adpcmWavHeader->adpcmFormat.wavFormat.bytesPerSecond = (uint64_t)sampleRate * ADPCM_BLOCK_SIZE / ADPCM_SAMPLES_PER_BLOCK;
+    adpcmWavHeader->numberOfSamples = numberOfSamples;
+    adpcmWavHeader->data.size = ADPCM_getNumberOfBytes(numberOfSamples);
+    adpcmWavHeader->riff.size = ADPCM_getNumberOfBytes(numberOfSamples) + sizeof(adpcmWavHeader_t) + guanoHeaderSize - sizeof(chunk_t);
+
+    memcpy(&adpcmWavHeader->icmt, &wavHeader->icmt, sizeof(icmt_t));
+    memcpy(&adpcmWavHeader->iart, &wavHeader->iart, sizeof(iart_t));
+
+}
+
+static void setHeaderComment(wavHeader_t *wavHeader, uint32_t currentTime, int8_t timezoneHours, int8_t timezoneMinutes, uint8_t *serialNumber, uint32_t gain, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature, bool switchPositionChanged, bool supplyVoltageLow, bool fileSizeLimited, bool totalFileSizeLimited, bool sdCardFull, bool bufferOverflow, uint32_t amplitudeThreshold, AM_filterType_t filterType, uint32_t lowerFilterFreq, uint32_t higherFilterFreq) {
 
     time_t rawtime = currentTime + timezoneHours * SECONDS_IN_HOUR + timezoneMinutes * SECONDS_IN_MINUTE;
 
@@ -347,7 +497,7 @@ static void setHeaderComment(wavHeader_t *wavHeader, uint32_t currentTime, int8_
 
     }
 
-    if (supplyVoltageLow || switchPositionChanged || fileSizeLimited || totalFileSizeLimited) {
+    if (supplyVoltageLow || switchPositionChanged || fileSizeLimited || totalFileSizeLimited || sdCardFull || bufferOverflow) {
 
         comment += sprintf(comment, " Recording cancelled before completion due to ");
 
@@ -367,6 +517,14 @@ static void setHeaderComment(wavHeader_t *wavHeader, uint32_t currentTime, int8_
 
             comment += sprintf(comment, "total file size limit.");
 
+        } else if (sdCardFull) {
+
+            comment += sprintf(comment, "SD card being full.");
+
+        } else if (bufferOverflow) {
+
+            comment += sprintf(comment, "buffer overflow.");
+
         }
 
     }
@@ -382,6 +540,7 @@ static const CP_configSettings_t defaultConfigSettings = {
     .enableLowVoltageCutoff = 1,
     .enableBatteryLevelDisplay = 1,
     .enableProprietaryFileFormat = 0,
+    .enableDailyFolders = 0,
     .initialSleepRecordCycles = 0,
     .numberOfSleepRecordCycles = 0,
     .enableOpportunisticRecording = 0,
@@ -399,6 +558,7 @@ static const CP_configSettings_t defaultConfigSettings = {
     .lowerFilterFreq = {0, 0},
     .higherFilterFreq = {0, 0},
     .amplitudeThreshold = {0, 0},
+    .enableADPCM = {0, 0},
     .activeStartStopPeriods = 0,
     .startStopPeriods = {
         {.startMinutes = 000, .stopMinutes = 060},
@@ -411,17 +571,41 @@ static const CP_configSettings_t defaultConfigSettings = {
     .latestRecordingTime = 0
 };
 
-/* Function to write the GUANO data */
+/* Functions to write the GUANO data. A field which does not fit in the space remaining in the buffer is left out whole */
+
+static uint32_t appendGuanoField(char *buffer, uint32_t length, uint32_t bufferSize, const char *format, ...) {
+
+    if (length >= bufferSize) return length;
 
-static uint32_t writeGuanoData(char *buffer, CP_configSettings_t *configSettings, uint32_t currentTime, uint32_t *acousticLocationReceived, int32_t *acousticLatitude, int32_t *acousticLongitude, uint8_t *firmwareDescription, uint8_t *firmwareVersion, uint8_t *serialNumber, char *filename, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature) {
+    va_list args;
 
-    uint32_t length = sprintf(buffer, "guan");
+    va_start(args, format);
+
+    int numberOfCharacters = vsnprintf(buffer + length, bufferSize - length, format, args);
+
+    va_end(args);
+
+    if (numberOfCharacters < 0 || length + numberOfCharacters >= bufferSize) {
+
+        buffer[length] = 0;
+
+        return length;
+
+    }
+
+    return length + numberOfCharacters;
+
+}
+
+static uint32_t writeGuanoData(char *buffer, uint32_t bufferSize, CP_configSettings_t *configSettings, uint32_t currentTime, uint32_t *acousticLocationReceived, int32_t *acousticLatitude, int32_t *acousticLongitude, uint8_t *firmwareDescription, uint8_t *firmwareVersion, uint8_t *serialNumber, char *filename, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature, bool rawCapture, int32_t dcOffset, uint32_t warmupDuration, uint32_t sdCardFreeSpace) {
+
+    uint32_t length = appendGuanoField(buffer, 0, bufferSize, "guan");
     
     length += UINT32_SIZE_IN_BYTES;
     
-    length += sprintf(buffer + length, "GUANO|Version:1.0\nMake:Open Acoustic Devices\nModel:AudioMoth\nSerial:" SERIAL_NUMBER "\n", FORMAT_SERIAL_NUMBER(serialNumber));
+    length = appendGuanoField(buffer, length, bufferSize, "GUANO|Version:1.0\nMake:Open Acoustic Devices\nModel:AudioMoth\nSerial:" SERIAL_NUMBER "\n", FORMAT_SERIAL_NUMBER(serialNumber));
 
-    length += sprintf(buffer + length, "Firmware Version:%s (%u.%u.%u)\n", firmwareDescription, firmwareVersion[0], firmwareVersion[1], firmwareVersion[2]);
+    length = appendGuanoField(buffer, length, bufferSize, "Firmware Version:%s (%u.%u.%u)\n", firmwareDescription, firmwareVersion[0], firmwareVersion[1], firmwareVersion[2]);
 
     int32_t timezoneOffset = configSettings->timezoneHours * SECONDS_IN_HOUR + configSettings->timezoneMinutes * SECONDS_IN_MINUTE;
 
@@ -431,19 +615,19 @@ static uint32_t writeGuanoData(char *buffer, CP_configSettings_t *configSettings
 
     gmtime_r(&rawTime, &time);
 
-    length += sprintf(buffer + length, "Timestamp:%04d-%02d-%02dT%02d:%02d:%02d", YEAR_OFFSET + time.tm_year, MONTH_OFFSET + time.tm_mon, time.tm_mday, time.tm_hour, time.tm_min, time.tm_sec);
+    length = appendGuanoField(buffer, length, bufferSize, "Timestamp:%04d-%02d-%02dT%02d:%02d:%02d", YEAR_OFFSET + time.tm_year, MONTH_OFFSET + time.tm_mon, time.tm_mday, time.tm_hour, time.tm_min, time.tm_sec);
 
     if (timezoneOffset == 0) {
 
-        length += sprintf(buffer + length, "Z\n");
+        length = appendGuanoField(buffer, length, bufferSize, "Z\n");
         
     } else if (timezoneOffset < 0) {
 
-        length += sprintf(buffer + length, "-%02d:%02d\n", ABS(configSettings->timezoneHours), ABS(configSettings->timezoneMinutes));
+        length = appendGuanoField(buffer, length, bufferSize, "-%02d:%02d\n", ABS(configSettings->timezoneHours), ABS(configSettings->timezoneMinutes));
 
     } else {
 
-        length += sprintf(buffer + length, "+%02d:%02d\n", configSettings->timezoneHours, configSettings->timezoneMinutes);
+        length = appendGuanoField(buffer, length, bufferSize, "+%02d:%02d\n", configSettings->timezoneHours, configSettings->timezoneMinutes);
 
     }
 
@@ -453,23 +637,43 @@ static uint32_t writeGuanoData(char *buffer, CP_configSettings_t *configSettings
 
         char *longitudeSign = *acousticLongitude < 0 ? "-" : "";
 
-        length += sprintf(buffer + length, "Loc Position:%s%ld.%06ld %s%ld.%06ld\nOAD|Loc Source:Acoustic chime\n", latitudeSign, ABS(*acousticLatitude) / ACOUSTIC_LOCATION_PRECISION, ABS(*acousticLatitude) % ACOUSTIC_LOCATION_PRECISION, longitudeSign, ABS(*acousticLongitude) / ACOUSTIC_LOCATION_PRECISION, ABS(*acousticLongitude) % ACOUSTIC_LOCATION_PRECISION);
+        length = appendGuanoField(buffer, length, bufferSize, "Loc Position:%s%ld.%06ld %s%ld.%06ld\nOAD|Loc Source:Acoustic chime\n", latitudeSign, ABS(*acousticLatitude) / ACOUSTIC_LOCATION_PRECISION, ABS(*acousticLatitude) % ACOUSTIC_LOCATION_PRECISION, longitudeSign, ABS(*acousticLongitude) / ACOUSTIC_LOCATION_PRECISION, ABS(*acousticLongitude) % ACOUSTIC_LOCATION_PRECISION);
 
     }
 
-    length += sprintf(buffer + length, "Original Filename:%s\n", filename);
+    length = appendGuanoField(buffer, length, bufferSize, "Original Filename:%s\n", filename);
 
     uint32_t batteryVoltage = extendedBatteryState == AM_EXT_BAT_LOW ? 24 : extendedBatteryState >= AM_EXT_BAT_FULL ? 50 : extendedBatteryState + AM_EXT_BAT_STATE_OFFSET / AM_BATTERY_STATE_INCREMENT;
 
-    length += sprintf(buffer + length, "OAD|Battery Voltage:%01lu.%01lu\n", batteryVoltage / 10, batteryVoltage % 10);
+    length = appendGuanoField(buffer, length, bufferSize, "OAD|Battery Voltage:%01lu.%01lu\n", batteryVoltage / 10, batteryVoltage % 10);
     
     char *temperatureSign = temperature < 0 ? "-" : "";
 
     uint32_t temperatureInDecidegrees = ROUNDED_DIV(ABS(temperature), 100);
 
-    length += sprintf(buffer + length, "Temperature Int:%s%lu.%lu", temperatureSign, temperatureInDecidegrees / 10, temperatureInDecidegrees % 10);
+    length = appendGuanoField(buffer, length, bufferSize, "Temperature Int:%s%lu.%lu", temperatureSign, temperatureInDecidegrees / 10, temperatureInDecidegrees % 10);
+
+    if (rawCapture) {
+
+        length = appendGuanoField(buffer, length, bufferSize, "\nOAD|DC Offset:%ld", dcOffset);
+
+    }
+
+    if (warmupDuration > 0) {
+
+        length = appendGuanoField(buffer, length, bufferSize, "\nOAD|Microphone Warm-up:%lu.%03lu", warmupDuration / MILLISECONDS_IN_SECOND, warmupDuration % MILLISECONDS_IN_SECOND);
+
+    }
+
+    length += CardLog_writeGuanoData(buffer + length, bufferSize - length);
+
+    if (sdCardFreeSpace != UINT32_MAX) {
+
+        length = appendGuanoField(buffer, length, bufferSize, "\nOAD|SD Card Free:%lu MB", sdCardFreeSpace);
+
+    }
     
-    *(uint32_t*)(buffer + RIFF_ID_LENGTH) = length - sizeof(chunk_t);;
+    *(uint32_t*)(buffer + RIFF_ID_LENGTH) = length - sizeof(chunk_t);
 
     return length;
 
@@ -525,6 +729,16 @@ static uint32_t *acousticLocationReceived = (uint32_t*)(AM_BACKUP_DOMAIN_START_A
 
 static CP_configSettings_t *configSettings = (CP_configSettings_t*)(AM_BACKUP_DOMAIN_START_ADDRESS + 48);
 
+static uint32_t *dateOfDailyFolder = (uint32_t*)(AM_BACKUP_DOMAIN_START_ADDRESS + 192);
+
+static AM_directoryLocation_t *dailyFolderLocation = (AM_directoryLocation_t*)(AM_BACKUP_DOMAIN_START_ADDRESS + 196);
+
+static AM_freeSpace_t *freeSpace = (AM_freeSpace_t*)(AM_BACKUP_DOMAIN_START_ADDRESS + 220);
+
+static AM_fileSystemCache_t *fileSystemCache = (AM_fileSystemCache_t*)(AM_BACKUP_DOMAIN_START_ADDRESS + 232);
+
+static uint32_t *formatRequested = (uint32_t*)(AM_BACKUP_DOMAIN_START_ADDRESS + 296);
+
 /* Filter variables */
 
 static AM_filterType_t requestedFilterType;
@@ -533,26 +747,76 @@ static AM_filterType_t requestedFilterType;
 
 static uint32_t numberOfSamplesInDMATransfer;
 
+/* Raw capture variables */
+
+static bool rawCaptureEnabled;
+
+static uint32_t rawCaptureIndex;
+
+static int32_t rawCaptureOffset;
+
+/* Core clock governor variables */
+
+static bool governorEvaluating;
+
+static uint32_t governorCoreClockDivider;
+
+static uint32_t governorStartCycles;
+
+static uint32_t governorStartSeconds;
+
+static uint32_t governorStartMilliseconds;
+
 /* SRAM buffer variables */
 
 static volatile uint32_t writeBuffer;
 
 static volatile uint32_t writeBufferIndex;
 
+static uint32_t readBuffer;
+
+static uint32_t readBufferIndex;
+
 static int16_t* buffers[NUMBER_OF_BUFFERS];
 
 /* Initial microphone warm-up period settings */
 
-static uint32_t dmaTransfersToSkip;
+static volatile uint32_t dmaTransfersToSkip;
 
 static volatile uint32_t dmaTransfersProcessed;
 
+static uint32_t minimumDMATransfersToSkip;
+
+static uint32_t warmupSettledTransfers;
+
+static int32_t warmupPreviousMean;
+
+static uint32_t warmupPreviousVariance;
+
+/* ADC settings and calibration variables */
+
+static AT_adcSettings_t adcSettings;
+
+static volatile bool calibrationEnabled;
+
+static uint32_t calibrationSampleRateDivider;
+
+static uint64_t calibrationSumOfSquares;
+
+static uint32_t calibrationNumberOfSamples;
+
 /* Compression buffers */
 
 static bool writeIndicator[NUMBER_OF_BUFFERS];
 
 static int16_t compressionBuffer[COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE];
 
+/* Block file header */
+
+static uint8_t blockHeader[BF_SECTOR_SIZE] __attribute__ ((aligned(4)));
+
+static uint16_t frameSizes[LL_MAXIMUM_NUMBER_OF_FRAMES];
+
 /* Audio configuration variables */
 
 static bool audioConfigStateLED;
@@ -569,6 +833,12 @@ static char fileReadBuffer[FILE_READ_BUFFER_LENGTH];
 
 static volatile bool switchPositionChanged;
 
+static bool captureRunning;
+
+static volatile bool bufferOverflow;
+
+static uint32_t recordedDuration;
+
 /* DMA buffers */
 
 static int16_t primaryBuffer[MAXIMUM_SAMPLES_IN_DMA_TRANSFER];
@@ -579,6 +849,18 @@ static int16_t secondaryBuffer[MAXIMUM_SAMPLES_IN_DMA_TRANSFER];
 
 static char filename[32];
 
+/* Files recorded since capture started, whose profile and SD card log are written once it stops */
+
+static bool recordingLogPending;
+
+static uint32_t numberOfLoggedFiles;
+
+static char firstLoggedFilename[32];
+
+static char loggedFilenames[2 * sizeof(filename) + 4];
+
+static AM_configurationIndex_t loggedConfigurationIndex;
+
 /* Firmware version and description */
 
 static uint8_t firmwareVersion[AM_FIRMWARE_VERSION_LENGTH] = {0, 1, 6};
@@ -593,6 +875,22 @@ static void scheduleRecording(uint32_t currentTime,  uint32_t *timeOfNextRecordi
 
 static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDuration, bool enableLED, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature);
 
+static bool calibrateADC(void);
+
+static bool testSDCard(void);
+
+static bool formatSDCard(void);
+
+static bool enterDailyFolder(struct tm *time);
+
+static bool writeVectorsWithinWriteUnits(AM_fileVector_t *vectors, uint32_t numberOfVectors, uint32_t writeUnitSize, uint32_t bytesWrittenToFile);
+
+static void saveFileSystemState(void);
+
+static void writeRecordingLogs(void);
+
+static uint32_t getSDCardPowerHoldInterval(void);
+
 /* Functions of copy to the backup domain */
 
 static void copyToBackupDomain(uint32_t *dst, uint8_t *src, uint32_t length) {
@@ -611,6 +909,70 @@ static void copyToBackupDomain(uint32_t *dst, uint8_t *src, uint32_t length) {
 
 }
 
+/* Function to calculate the mean of a block of samples */
+
+AM_RAMFUNC static int32_t calculateMean(int16_t *buffer, uint32_t numberOfSamples) {
+
+    int32_t sum = 0;
+
+    for (uint32_t i = 0; i < numberOfSamples; i += 1) {
+
+        sum += buffer[i];
+
+    }
+
+    return sum / (int32_t)numberOfSamples;
+
+}
+
+/* Function to end the microphone warm-up once the mean and variance of successive blocks have settled */
+
+AM_RAMFUNC static void updateWarmUp(int16_t *buffer, uint32_t numberOfSamples) {
+
+    int32_t sum = 0;
+
+    int64_t sumOfSquares = 0;
+
+    for (uint32_t i = 0; i < numberOfSamples; i += 1) {
+
+        sum += buffer[i];
+
+        sumOfSquares += buffer[i] * buffer[i];
+
+    }
+
+    int32_t mean = sum / (int32_t)numberOfSamples;
+
+    uint32_t variance = sumOfSquares / numberOfSamples - (int64_t)mean * mean;
+
+    /* A settling microphone shows as a drifting mean and a variance that is still falling */
+
+    if (dmaTransfersProcessed > 0) {
+
+        int64_t meanChange = mean - warmupPreviousMean;
+
+        bool meanSettled = WARMUP_MEAN_CHANGE_RATIO * meanChange * meanChange <= variance;
+
+        bool varianceSettled = variance <= WARMUP_VARIANCE_RATIO * warmupPreviousVariance + 1 && warmupPreviousVariance <= WARMUP_VARIANCE_RATIO * variance + 1;
+
+        warmupSettledTransfers = meanSettled && varianceSettled ? warmupSettledTransfers + 1 : 0;
+
+    }
+
+    warmupPreviousMean = mean;
+
+    warmupPreviousVariance = variance;
+
+    /* Start storing samples after the next transfer */
+
+    if (warmupSettledTransfers >= WARMUP_SETTLED_TRANSFERS && dmaTransfersProcessed + 1 >= minimumDMATransfersToSkip) {
+
+        dmaTransfersToSkip = dmaTransfersProcessed + 1;
+
+    }
+
+}
+
 /* Main function */
 
 int main(void) {
@@ -641,6 +1003,18 @@ int main(void) {
 
         *previousDayOfYear = UINT32_MAX;
 
+        *dateOfDailyFolder = 0;
+
+        AM_freeSpace_t noFreeSpace = {0};
+
+        copyToBackupDomain((uint32_t*)freeSpace, (uint8_t*)&noFreeSpace, sizeof(AM_freeSpace_t));
+
+        AM_fileSystemCache_t noFileSystemCache = {0};
+
+        copyToBackupDomain((uint32_t*)fileSystemCache, (uint8_t*)&noFileSystemCache, sizeof(AM_fileSystemCache_t));
+
+        *formatRequested = false;
+
         *acousticLocationReceived = false;
 
         copyToBackupDomain((uint32_t*)configSettings, (uint8_t*)&defaultConfigSettings, sizeof(CP_configSettings_t));
@@ -759,10 +1133,48 @@ int main(void) {
 
         }
 
+        /* Format the SD card if requested by the marker file or over USB. The configuration file has already been read and is restored afterwards */
+
+        if (*readyToMakeRecordings && (*formatRequested || AudioMoth_doesFileExist(FORMAT_FILENAME))) {
+
+            *formatRequested = false;
+
+            *readyToMakeRecordings = formatSDCard();
+
+        }
+
         /* Write configuration file to SD card */
 
         if (*readyToMakeRecordings) *readyToMakeRecordings = writeConfigurationToFile(configSettings, firmwareDescription, firmwareVersion, (uint8_t*)AM_UNIQUE_ID_START_ADDRESS);
 
+        /* Count the free space once from the file system information sector or the allocation bitmap, and save the volume parameters for later mounts */
+
+        if (*readyToMakeRecordings) saveFileSystemState();
+
+        /* Calibrate the ADC settings if requested. The trigger file is removed once the calibration has been stored */
+
+        if (*readyToMakeRecordings && AudioMoth_doesFileExist(ADC_TUNE_FILENAME)) {
+
+            bool calibrated = calibrateADC();
+
+            if (calibrated) calibrated = AudioMoth_deleteFile(ADC_TUNE_FILENAME);
+
+            if (!calibrated) FLASH_LED(Both, LONG_LED_FLASH_DURATION);
+
+        }
+
+        /* Test the SD card write throughput if requested. The trigger file is removed once the result has been written */
+
+        if (*readyToMakeRecordings && AudioMoth_doesFileExist(SD_TEST_FILENAME)) {
+
+            bool tested = testSDCard();
+
+            if (tested) tested = AudioMoth_deleteFile(SD_TEST_FILENAME);
+
+            if (!tested) FLASH_LED(Both, LONG_LED_FLASH_DURATION);
+
+        }
+
         /* Schedule recording */
 
         if (*readyToMakeRecordings) {
@@ -775,6 +1187,8 @@ int main(void) {
 
             *previousDayOfYear = UINT32_MAX;
 
+            *dateOfDailyFolder = 0;
+
             AudioMoth_getTime(&currentTime, NULL);
 
             scheduleRecording(currentTime, timeOfNextRecording, configurationIndexOfNextRecording, durationOfNextRecording);
@@ -799,91 +1213,123 @@ int main(void) {
 
     if (currentTime >= *timeOfNextRecording) {
 
-        /* Reduce the recording duration if necessary */
+        AM_extendedBatteryState_t extendedBatteryState = AM_EXT_BAT_LOW;
 
-        uint32_t missedSeconds = MIN(currentTime - *timeOfNextRecording, *durationOfNextRecording);
+        int32_t temperature = 0;
 
-        *durationOfNextRecording -= missedSeconds;
+        bool continueRecording = false;
 
-        /* Make the recording */
+        do {
 
-        AM_recordingState_t recordingState = RECORDING_OKAY;
+            /* Reduce the recording duration if necessary */
 
-        if (*durationOfNextRecording > 0) {
+            uint32_t missedSeconds = MIN(currentTime - *timeOfNextRecording, *durationOfNextRecording);
 
-            /* Measure battery voltage */
+            *durationOfNextRecording -= missedSeconds;
 
-            uint32_t supplyVoltage = AudioMoth_getSupplyVoltage();
+            /* Make the recording */
 
-            AM_extendedBatteryState_t extendedBatteryState = AudioMoth_getExtendedBatteryState(supplyVoltage);
+            AM_recordingState_t recordingState = RECORDING_OKAY;
 
-            /* Check if low voltage check is enabled and that the voltage is okay */
+            AM_configurationIndex_t configurationIndexOfRecording = *configurationIndexOfNextRecording;
 
-            bool okayToMakeRecording = true;
+            recordedDuration = 0;
 
-            if (configSettings->enableLowVoltageCutoff) {
+            if (*durationOfNextRecording > 0 && continueRecording) {
 
-                AudioMoth_enableSupplyMonitor();
+                /* The microphone, file system and supply monitor are still running from the previous recording */
 
-                AudioMoth_setSupplyMonitorThreshold(MINIMUM_SUPPLY_VOLTAGE);
+                recordingState = makeRecording(currentTime, *durationOfNextRecording, configSettings->enableLED, extendedBatteryState, temperature);
 
-                okayToMakeRecording = AudioMoth_isSupplyAboveThreshold();
+            } else if (*durationOfNextRecording > 0) {
 
-            }
+                /* Measure battery voltage */
+
+                uint32_t supplyVoltage = AudioMoth_getSupplyVoltage();
+
+                extendedBatteryState = AudioMoth_getExtendedBatteryState(supplyVoltage);
+
+                /* Check if low voltage check is enabled and that the voltage is okay */
+
+                bool okayToMakeRecording = true;
 
-            /* Make recording if okay */
+                if (configSettings->enableLowVoltageCutoff) {
 
-            if (okayToMakeRecording) {
+                    AudioMoth_enableSupplyMonitor();
 
-                AudioMoth_enableTemperature();
+                    AudioMoth_setSupplyMonitorThreshold(MINIMUM_SUPPLY_VOLTAGE);
 
-                int32_t temperature = AudioMoth_getTemperature();
+                    okayToMakeRecording = AudioMoth_isSupplyAboveThreshold();
 
-                AudioMoth_disableTemperature();
+                }
+
+                /* Make recording if okay */
+
+                if (okayToMakeRecording) {
+
+                    AudioMoth_enableTemperature();
+
+                    temperature = AudioMoth_getTemperature();
+
+                    AudioMoth_disableTemperature();
+
+                    if (configSettings->enableEnergySaverMode[*configurationIndexOfNextRecording]) AudioMoth_setClockDivider(AM_HF_CLK_DIV2);
+
+                    bool fileSystemEnabled = AudioMoth_enableFileSystemUsingCache(AM_SD_CARD_TUNED_SPEED, fileSystemCache);
 
-                if (configSettings->enableEnergySaverMode[*configurationIndexOfNextRecording]) AudioMoth_setClockDivider(AM_HF_CLK_DIV2);
+                    if (fileSystemEnabled) {
 
-                bool fileSystemEnabled = AudioMoth_enableFileSystem(configSettings->sampleRateDivider[*configurationIndexOfNextRecording] == 1 ? AM_SD_CARD_HIGH_SPEED : AM_SD_CARD_NORMAL_SPEED);
+                        recordingState = makeRecording(currentTime, *durationOfNextRecording, configSettings->enableLED, extendedBatteryState, temperature);
 
-                if (fileSystemEnabled) {
+                    } else {
 
-                    recordingState = makeRecording(currentTime, *durationOfNextRecording, configSettings->enableLED, extendedBatteryState, temperature);
+                        FLASH_LED(Both, LONG_LED_FLASH_DURATION);
+
+                        recordingState = SDCARD_WRITE_ERROR;
+
+                    }
 
                 } else {
 
-                    FLASH_LED(Both, LONG_LED_FLASH_DURATION);
+                    if (configSettings->enableLED) FLASH_LED(Both, LONG_LED_FLASH_DURATION);
 
-                    recordingState = SDCARD_WRITE_ERROR;
+                    recordingState = SUPPLY_VOLTAGE_LOW;
 
                 }
 
-            } else {
+            }
 
-                if (configSettings->enableLED) FLASH_LED(Both, LONG_LED_FLASH_DURATION);
+            /* Schedule next recording. The rest of a recording cut short by a buffer overflow is made once the microphone has restarted */
 
-                recordingState = SUPPLY_VOLTAGE_LOW;
+            if (recordingState != FILE_SIZE_LIMITED && recordingState != BUFFER_OVERFLOW) {
+
+                scheduleRecording(currentTime + *durationOfNextRecording, timeOfNextRecording, configurationIndexOfNextRecording, durationOfNextRecording);
 
             }
 
-            /* Disable low voltage monitor if it was used */
+            /* Count the recording if it finished okay and was a full recording */
 
-            if (configSettings->enableLowVoltageCutoff) AudioMoth_disableSupplyMonitor();
+            if (recordingState == RECORDING_OKAY && configSettings->numberOfSleepRecordCycles == INITIAL_AND_STANDARD_SLEEP_RECORD_CYCLES && *durationOfNextRecording == configSettings->recordDuration[INITIAL_SLEEP_RECORD_CYCLE]) *numberOfCompleteInitialRecordings += 1;
 
-        }
+            *numberOfRecordings += 1;
 
-        /* Schedule next recording */
+            /* Roll straight into the next file without stopping the microphone if it starts as this one ends and no samples have been lost since */
 
-        if (recordingState != FILE_SIZE_LIMITED) {
+            uint32_t endOfRecording = currentTime + recordedDuration;
 
-            scheduleRecording(currentTime + *durationOfNextRecording, timeOfNextRecording, configurationIndexOfNextRecording, durationOfNextRecording);
+            continueRecording = captureRunning && !bufferOverflow && recordedDuration > 0 && (recordingState == FILE_SIZE_LIMITED || (recordingState == RECORDING_OKAY && *timeOfNextRecording == endOfRecording && *configurationIndexOfNextRecording == configurationIndexOfRecording));
 
-        }
+            if (continueRecording) currentTime = endOfRecording;
+
+        } while (continueRecording);
 
-        /* Count the recording if it finished okay and was a full recording */
+        writeRecordingLogs();
 
-        if (recordingState == RECORDING_OKAY && configSettings->numberOfSleepRecordCycles == INITIAL_AND_STANDARD_SLEEP_RECORD_CYCLES && *durationOfNextRecording == configSettings->recordDuration[INITIAL_SLEEP_RECORD_CYCLE]) *numberOfCompleteInitialRecordings += 1;
+        /* Return to the full core clock and disable low voltage monitor if it was used */
 
-        *numberOfRecordings += 1;
+        AudioMoth_setCoreClockDivider(AM_HF_CLK_DIV1);
+
+        if (configSettings->enableLowVoltageCutoff) AudioMoth_disableSupplyMonitor();
 
     } else if (configSettings->enableLED) {
 
@@ -903,6 +1349,16 @@ int main(void) {
 
     }
 
+    /* Keep the SD card powered if the next recording starts before the break-even point */
+
+    uint32_t timeNow;
+
+    AudioMoth_getTime(&timeNow, NULL);
+
+    uint32_t secondsUntilNextRecording = *timeOfNextRecording > timeNow ? *timeOfNextRecording - timeNow : 0;
+
+    if (secondsUntilNextRecording < getSDCardPowerHoldInterval()) AudioMoth_keepSDCardPowered();
+
     /* Power down */
 
     SAVE_SWITCH_POSITION_AND_POWER_DOWN(secondsToSleep);
@@ -932,59 +1388,169 @@ inline void AudioMoth_handleSwitchInterrupt() {
 
 inline void AudioMoth_handleMicrophoneChangeInterrupt() { }
 
-inline void AudioMoth_handleDirectMemoryAccessInterrupt(bool isPrimaryBuffer, int16_t **nextBuffer) {
-
-    int16_t *source = secondaryBuffer;
+AM_RAMFUNC void AudioMoth_handleDirectMemoryAccessInterrupt(bool isPrimaryBuffer, int16_t **nextBuffer) {
 
-    if (isPrimaryBuffer) source = primaryBuffer;
+    /* During ADC calibration the filter output is only measured */
 
-    /* Update the current buffer index and write buffer */
+    if (calibrationEnabled) {
 
-    bool thresholdExceeded = DigitalFilter_filter(source, buffers[writeBuffer] + writeBufferIndex, configSettings->sampleRateDivider[*configurationIndexOfNextRecording], numberOfSamplesInDMATransfer, configSettings->amplitudeThreshold[*configurationIndexOfNextRecording]);
+        int16_t *source = isPrimaryBuffer ? primaryBuffer : secondaryBuffer;
 
-    if (dmaTransfersProcessed > dmaTransfersToSkip) {
+        uint32_t numberOfSamples = numberOfSamplesInDMATransfer / calibrationSampleRateDivider;
 
-        writeIndicator[writeBuffer] |= thresholdExceeded;
+        DigitalFilter_filter(source, source, calibrationSampleRateDivider, numberOfSamplesInDMATransfer, 0);
 
-        writeBufferIndex += numberOfSamplesInDMATransfer / configSettings->sampleRateDivider[*configurationIndexOfNextRecording];
+        if (dmaTransfersProcessed >= dmaTransfersToSkip) {
 
-        if (writeBufferIndex == NUMBER_OF_SAMPLES_IN_BUFFER) {
+            for (uint32_t i = 0; i < numberOfSamples; i += 1) calibrationSumOfSquares += source[i] * source[i];
 
-            writeBufferIndex = 0;
+            calibrationNumberOfSamples += numberOfSamples;
 
-            writeBuffer = (writeBuffer + 1) & (NUMBER_OF_BUFFERS - 1);
+        }
 
-            writeIndicator[writeBuffer] = false;
+        dmaTransfersProcessed += 1;
 
-        }
+        return;
 
     }
 
-    dmaTransfersProcessed += 1;
+    PROFILER_START(interruptStart);
 
-}
+    /* In raw capture mode the samples are already in the SRAM buffers so only the destination of the next transfer is updated */
 
-/* AudioMoth USB message handlers */
+    if (rawCaptureEnabled) {
 
-inline void AudioMoth_usbFirmwareVersionRequested(uint8_t **firmwareVersionPtr) {
+        if (dmaTransfersProcessed < dmaTransfersToSkip) updateWarmUp(isPrimaryBuffer ? buffers[0] : buffers[0] + numberOfSamplesInDMATransfer, numberOfSamplesInDMATransfer);
 
-    *firmwareVersionPtr = firmwareVersion;
+        if (dmaTransfersProcessed == dmaTransfersToSkip) {
 
-}
+            rawCaptureOffset = calculateMean(isPrimaryBuffer ? buffers[0] : buffers[0] + numberOfSamplesInDMATransfer, numberOfSamplesInDMATransfer);
 
-inline void AudioMoth_usbFirmwareDescriptionRequested(uint8_t **firmwareDescriptionPtr) {
+        }
 
-    *firmwareDescriptionPtr = firmwareDescription;
+        if (dmaTransfersProcessed + 1 >= dmaTransfersToSkip) {
 
-}
+            /* The transfer being set up is filled before the write buffer advances, so it overflows the ring as soon as it reaches the oldest unwritten buffer */
 
-inline void AudioMoth_usbApplicationPacketRequested(uint32_t messageType, uint8_t *transmitBuffer, uint32_t size) { }
+            uint32_t nextWriteBuffer = rawCaptureIndex / NUMBER_OF_SAMPLES_IN_BUFFER;
 
-inline void AudioMoth_usbApplicationPacketReceived(uint32_t messageType, uint8_t* receiveBuffer, uint8_t *transmitBuffer, uint32_t size) { }
+            if (nextWriteBuffer != writeBuffer && nextWriteBuffer == readBuffer) bufferOverflow = true;
 
-/* Audio configuration handlers */
+            *nextBuffer = buffers[0] + rawCaptureIndex;
 
-void AudioConfig_handleAudioConfigurationEvent(AC_audioConfigurationEvent_t event) {
+            rawCaptureIndex = (rawCaptureIndex + numberOfSamplesInDMATransfer) % EXTERNAL_SRAM_SIZE_IN_SAMPLES;
+
+        }
+
+        if (dmaTransfersProcessed > dmaTransfersToSkip) {
+
+            writeIndicator[writeBuffer] = true;
+
+            writeBufferIndex += numberOfSamplesInDMATransfer;
+
+            if (writeBufferIndex == NUMBER_OF_SAMPLES_IN_BUFFER) {
+
+                writeBufferIndex = 0;
+
+                writeBuffer = (writeBuffer + 1) & (NUMBER_OF_BUFFERS - 1);
+
+            }
+
+            PROFILER_ADD_TRANSFER(writeBufferIndex == 0);
+
+        }
+
+        dmaTransfersProcessed += 1;
+
+        PROFILER_STOP(interruptStart, PR_DMA_INTERRUPT);
+
+        return;
+
+    }
+
+    int16_t *source = secondaryBuffer;
+
+    if (isPrimaryBuffer) source = primaryBuffer;
+
+    /* Filter in place into the DMA buffer and copy the output to the SRAM buffer by DMA. The buffer is not refilled until the other buffer completes */
+
+    PROFILER_START(filterStart);
+
+    bool thresholdExceeded = DigitalFilter_filter(source, source, configSettings->sampleRateDivider[*configurationIndexOfNextRecording], numberOfSamplesInDMATransfer, configSettings->amplitudeThreshold[*configurationIndexOfNextRecording]);
+
+    PROFILER_STOP(filterStart, configSettings->amplitudeThreshold[*configurationIndexOfNextRecording] > 0 ? PR_DIGITAL_FILTER_WITH_THRESHOLD : PR_DIGITAL_FILTER);
+
+    AudioMoth_startMemoryCopy(buffers[writeBuffer] + writeBufferIndex, source, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesInDMATransfer / configSettings->sampleRateDivider[*configurationIndexOfNextRecording]);
+
+    /* Watch the filter output to end the warm-up */
+
+    if (dmaTransfersProcessed < dmaTransfersToSkip) updateWarmUp(source, numberOfSamplesInDMATransfer / configSettings->sampleRateDivider[*configurationIndexOfNextRecording]);
+
+    /* Update the current buffer index and write buffer */
+
+    if (dmaTransfersProcessed > dmaTransfersToSkip) {
+
+        writeIndicator[writeBuffer] |= thresholdExceeded;
+
+        writeBufferIndex += numberOfSamplesInDMATransfer / configSettings->sampleRateDivider[*configurationIndexOfNextRecording];
+
+        if (writeBufferIndex == NUMBER_OF_SAMPLES_IN_BUFFER) {
+
+            writeBufferIndex = 0;
+
+            writeBuffer = (writeBuffer + 1) & (NUMBER_OF_BUFFERS - 1);
+
+            writeIndicator[writeBuffer] = false;
+
+            /* The ring has overflowed if the next buffer to fill has not been written to the SD card */
+
+            if (writeBuffer == readBuffer) bufferOverflow = true;
+
+        }
+
+        PROFILER_ADD_TRANSFER(writeBufferIndex == 0);
+
+    }
+
+    dmaTransfersProcessed += 1;
+
+    PROFILER_STOP(interruptStart, PR_DMA_INTERRUPT);
+
+}
+
+/* AudioMoth USB message handlers */
+
+inline void AudioMoth_usbFirmwareVersionRequested(uint8_t **firmwareVersionPtr) {
+
+    *firmwareVersionPtr = firmwareVersion;
+
+}
+
+inline void AudioMoth_usbFirmwareDescriptionRequested(uint8_t **firmwareDescriptionPtr) {
+
+    *firmwareDescriptionPtr = firmwareDescription;
+
+}
+
+inline void AudioMoth_usbApplicationPacketRequested(uint32_t messageType, uint8_t *transmitBuffer, uint32_t size) { }
+
+inline void AudioMoth_usbApplicationPacketReceived(uint32_t messageType, uint8_t* receiveBuffer, uint8_t *transmitBuffer, uint32_t size) {
+
+    /* The SD card is formatted on the next change to the CUSTOM position as the format takes too long to complete over USB */
+
+    if (receiveBuffer[1] == USB_FORMAT_SD_CARD_COMMAND) {
+
+        *formatRequested = true;
+
+        transmitBuffer[1] = USB_FORMAT_SD_CARD_COMMAND;
+
+    }
+
+}
+
+/* Audio configuration handlers */
+
+void AudioConfig_handleAudioConfigurationEvent(AC_audioConfigurationEvent_t event) {
 
     if (!AudioMoth_hasTimeBeenSet()) {
 
@@ -1000,165 +1566,663 @@ void AudioConfig_handleAudioConfigurationEvent(AC_audioConfigurationEvent_t even
 
         } else if (event == AC_EVENT_BYTE) {
 
-            audioConfigToggleLED = !audioConfigToggleLED;
+            audioConfigToggleLED = !audioConfigToggleLED;
+
+        } else if (event == AC_EVENT_BIT_ERROR || event == AC_EVENT_CRC_ERROR) {
+
+            audioConfigStateLED = false;
+
+        }
+
+        AudioMoth_setGreenLED((audioConfigStateLED && audioConfigToggleLED) || (!audioConfigStateLED && !audioConfigPulseCounter));
+
+    }
+
+}
+
+void AudioConfig_handleAudioConfigurationPacket(uint8_t *receiveBuffer, uint32_t size) {
+
+    uint32_t standardPacketSize = UINT32_SIZE_IN_BYTES + UINT16_SIZE_IN_BYTES;
+
+    bool standardPacket = size == standardPacketSize;
+
+    bool hasLocation = size == standardPacketSize + ACOUSTIC_LOCATION_SIZE_IN_BYTES;
+
+    if (AudioMoth_hasTimeBeenSet() == false && (standardPacket || hasLocation)) {
+
+        uint32_t time;
+
+        memcpy(&time, receiveBuffer, UINT32_SIZE_IN_BYTES);
+
+        AudioMoth_setTime(time + AUDIO_CONFIG_TIME_CORRECTION, 0);
+
+        AudioMoth_setGreenLED(true);
+
+        if (hasLocation) {
+
+            acousticLocation_t location;
+
+            memcpy(&location, receiveBuffer + standardPacketSize, ACOUSTIC_LOCATION_SIZE_IN_BYTES);
+
+            *acousticLocationReceived = true;
+
+            *acousticLatitude = location.latitude;
+            
+            *acousticLongitude = location.longitude * ACOUSTIC_LONGITUDE_MULTIPLIER;
+
+        }
+
+    }
+
+    /* Reset receive state */
+
+    audioConfigStateLED = false;
+
+    audioConfigPulseCounter = 0;
+
+}
+
+/* Encode the compression buffer */
+
+static void encodeCompressionBuffer(uint32_t numberOfCompressedBuffers) {
+
+    for (uint32_t i = 0; i < UINT32_SIZE_IN_BITS; i += 1) {
+
+        compressionBuffer[i] = numberOfCompressedBuffers & 0x01 ? 1 : -1;
+
+        numberOfCompressedBuffers >>= 1;
+
+    }
+
+    for (uint32_t i = UINT32_SIZE_IN_BITS; i < COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE; i += 1) {
+
+        compressionBuffer[i] = 0;
+
+    }
+
+}
+
+/* Calculate the largest DMA transfer which fits in the DMA buffers and decimates to a power of two */
+
+static uint32_t calculateSamplesInDMATransfer(uint32_t sampleRateDivider) {
+
+    uint32_t numberOfSamples = MAXIMUM_SAMPLES_IN_DMA_TRANSFER / sampleRateDivider;
+
+    while (numberOfSamples & (numberOfSamples - 1)) {
+
+        numberOfSamples = numberOfSamples & (numberOfSamples - 1);
+
+    }
+
+    return numberOfSamples * sampleRateDivider;
+
+}
+
+/* Calibrate the ADC by measuring the noise floor of each feasible setting with the input shorted or in a quiet room */
+
+static bool calibrateADC(void) {
+
+    static char resultBuffer[FILE_WRITE_BUFFER_LENGTH];
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_openFile(ADC_TUNE_RESULT_FILENAME));
+
+    uint32_t length = sprintf(resultBuffer, "Sample rate,Clock divider,Acquisition cycles,Oversample rate,Modelled cost,Noise,Kept\n");
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(resultBuffer, length));
+
+    ADCTuner_startCalibration();
+
+    for (uint32_t i = 0; i < NUMBER_OF_SETTINGS; i += 1) {
+
+        uint32_t sampleRate = configSettings->sampleRate[i];
+
+        /* Each sample rate is only calibrated once */
+
+        bool alreadyCalibrated = false;
+
+        for (uint32_t j = 0; j < i; j += 1) alreadyCalibrated |= configSettings->sampleRate[j] == sampleRate;
+
+        if (alreadyCalibrated) continue;
+
+        calibrationSampleRateDivider = configSettings->sampleRateDivider[i];
+
+        numberOfSamplesInDMATransfer = calculateSamplesInDMATransfer(calibrationSampleRateDivider);
+
+        uint32_t transfersToMeasure = MAX(1, sampleRate / FRACTION_OF_SECOND_FOR_CALIBRATION / numberOfSamplesInDMATransfer);
+
+        for (uint32_t j = 0; j < ADCTuner_getNumberOfCandidates(); j += 1) {
+
+            AT_adcSettings_t settings;
+
+            if (!ADCTuner_getCandidate(j, sampleRate, AudioMoth_getClockFrequency(), &settings)) continue;
+
+            /* Set up the DC blocking filter with the gain for these settings */
+
+            DigitalFilter_designHighPassFilter(sampleRate / calibrationSampleRateDivider, DC_BLOCKING_FREQ);
+
+            DigitalFilter_applyAdditionalGain(16.0f / (float)(settings.oversampleRate * calibrationSampleRateDivider));
+
+            DigitalFilter_reset();
+
+            /* Measure the noise after the warm-up period */
+
+            calibrationSumOfSquares = 0;
+
+            calibrationNumberOfSamples = 0;
+
+            dmaTransfersProcessed = 0;
+
+            dmaTransfersToSkip = sampleRate / FRACTION_OF_SECOND_FOR_WARMUP / numberOfSamplesInDMATransfer;
+
+            calibrationEnabled = true;
+
+            AudioMoth_enableMicrophone(AM_NORMAL_GAIN_RANGE, configSettings->gain[i], settings.clockDivider, settings.acquisitionCycles, settings.oversampleRate);
+
+            AudioMoth_initialiseDirectMemoryAccess(primaryBuffer, secondaryBuffer, numberOfSamplesInDMATransfer);
+
+            AudioMoth_startMicrophoneSamples(sampleRate);
+
+            while (dmaTransfersProcessed < dmaTransfersToSkip + transfersToMeasure && !switchPositionChanged) AudioMoth_sleep();
+
+            AudioMoth_disableMicrophone();
+
+            calibrationEnabled = false;
+
+            if (switchPositionChanged) {
+
+                AudioMoth_closeFile();
+
+                return false;
+
+            }
+
+            /* Keep the measurement if no other setting is both cheaper and quieter */
+
+            uint32_t noise = NOISE_MULTIPLIER * sqrtf((float)calibrationSumOfSquares / (float)MAX(1, calibrationNumberOfSamples));
+
+            bool kept = ADCTuner_addMeasurement(sampleRate, &settings, noise);
+
+            length = sprintf(resultBuffer, "%lu,%u,%u,%u,%lu,%lu.%02lu,%u\n", sampleRate, settings.clockDivider, settings.acquisitionCycles, settings.oversampleRate, ADCTuner_getCost(sampleRate, &settings), noise / NOISE_MULTIPLIER, noise % NOISE_MULTIPLIER, kept);
+
+            RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(resultBuffer, length));
+
+        }
+
+    }
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_closeFile());
+
+    return ADCTuner_finishCalibration();
+
+}
+
+/* Test the SD card by replaying the recorder write pattern from the external SRAM ring at each card speed */
+
+static bool testSDCard(void) {
+
+    static char resultBuffer[SD_TEST_RESULT_BUFFER_LENGTH];
+
+    static const AM_sdCardSpeed_t speeds[] = {AM_SD_CARD_NORMAL_SPEED, AM_SD_CARD_HIGH_SPEED, AM_SD_CARD_TUNED_SPEED};
+
+    static char *speedNames[] = {"Normal speed", "High speed", "Tuned speed"};
+
+    uint32_t length = sprintf(resultBuffer, "Allocation unit: %lu bytes\n\n", AudioMoth_getSDCardAllocationUnitSize());
+
+    AudioMoth_enableExternalSRAM();
+
+    /* The speeds are tested in increasing order as the doubled SPI clock persists until the card is powered down */
+
+    bool success = true;
+
+    for (uint32_t i = 0; i < sizeof(speeds) / sizeof(AM_sdCardSpeed_t); i += 1) {
+
+        AudioMoth_disableFileSystem();
+
+        bool tested = AudioMoth_enableFileSystem(speeds[i]);
+
+        if (tested) tested = SDTest_run(SD_TEST_DATA_FILENAME, (uint8_t*)AM_EXTERNAL_SRAM_START_ADDRESS, NUMBER_OF_BYTES_IN_SAMPLE * NUMBER_OF_SAMPLES_IN_BUFFER, NUMBER_OF_BUFFERS);
+
+        length += SDTest_writeResult(resultBuffer + length, speedNames[i], tested);
+
+        success &= tested;
+
+    }
+
+    AudioMoth_disableExternalSRAM();
+
+    /* Remount the file system to write the results in case the last test left it in an error state */
+
+    AudioMoth_disableFileSystem();
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_enableFileSystem(AM_SD_CARD_TUNED_SPEED));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_openFile(SD_TEST_RESULT_FILENAME));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(resultBuffer, length));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_closeFile());
+
+    return success;
+
+}
+
+/* Format the SD card using the external SRAM as the work area. The configuration file is kept in the top of the SRAM and written back to the new file system */
+
+static bool formatSDCard(void) {
+
+    uint8_t *workBuffer = (uint8_t*)AM_EXTERNAL_SRAM_START_ADDRESS;
+
+    char *configurationBuffer = (char*)(AM_EXTERNAL_SRAM_START_ADDRESS + AM_EXTERNAL_SRAM_SIZE_IN_BYTES - MAX_FILE_READ_CHARACTERS - 1);
+
+    AudioMoth_enableExternalSRAM();
+
+    memset(configurationBuffer, 0, MAX_FILE_READ_CHARACTERS + 1);
+
+    bool success = AudioMoth_openFileToRead("CONFIG.TXT");
+
+    if (success) success = AudioMoth_readFile(configurationBuffer, MAX_FILE_READ_CHARACTERS);
+
+    if (success) success = AudioMoth_closeFile();
+
+    /* Format with both LEDs lit as erasing a large card can take some time */
+
+    AudioMoth_setBothLED(true);
+
+    if (success) success = AudioMoth_formatFileSystem(workBuffer, configurationBuffer - (char*)workBuffer);
+
+    AudioMoth_setBothLED(false);
+
+    /* Remount the new file system and restore the configuration file */
+
+    AudioMoth_disableFileSystem();
+
+    if (success) success = AudioMoth_enableFileSystem(AM_SD_CARD_NORMAL_SPEED);
+
+    if (success) success = AudioMoth_openFile("CONFIG.TXT");
+
+    if (success) success = AudioMoth_writeToFile(configurationBuffer, strlen(configurationBuffer));
+
+    if (success) success = AudioMoth_closeFile();
+
+    AudioMoth_disableExternalSRAM();
+
+    return success;
+
+}
+
+/* Core clock governor */
+
+static void setGovernorCoreClockDivider(uint32_t divider) {
+
+    governorCoreClockDivider = divider;
+
+    AudioMoth_setCoreClockDivider(divider == 4 ? AM_HF_CLK_DIV4 : divider == 2 ? AM_HF_CLK_DIV2 : AM_HF_CLK_DIV1);
+
+}
+
+static void startClockGovernor(void) {
+
+    setGovernorCoreClockDivider(1);
+
+    governorEvaluating = true;
+
+    governorStartCycles = AudioMoth_getCycleCount();
+
+    AudioMoth_getTime(&governorStartSeconds, &governorStartMilliseconds);
+
+}
+
+static void updateClockGovernor(uint32_t ringOccupancy) {
+
+    /* Return to the full core clock for the rest of the recording if the SD card writes fall behind */
+
+    if (ringOccupancy >= GOVERNOR_RING_OCCUPANCY_LIMIT) {
+
+        if (governorCoreClockDivider > 1) setGovernorCoreClockDivider(1);
+
+        governorEvaluating = false;
+
+        return;
+
+    }
+
+    if (!governorEvaluating) return;
+
+    /* Wait for the end of the evaluation period */
+
+    uint32_t currentSeconds, currentMilliseconds;
+
+    AudioMoth_getTime(&currentSeconds, &currentMilliseconds);
+
+    uint32_t elapsedMilliseconds = (currentSeconds - governorStartSeconds) * MILLISECONDS_IN_SECOND + currentMilliseconds - governorStartMilliseconds;
+
+    if (elapsedMilliseconds < GOVERNOR_EVALUATION_PERIOD_IN_MILLISECONDS) return;
+
+    governorEvaluating = false;
+
+    /* The cycle counter stops during sleep so it measures the time spent in the interrupt handler and writing to the SD card */
+
+    uint32_t busyCycles = AudioMoth_getCycleCount() - governorStartCycles;
+
+    uint64_t availableCycles = (uint64_t)elapsedMilliseconds * (AudioMoth_getCoreClockFrequency() / MILLISECONDS_IN_SECOND);
+
+    uint32_t dutyCyclePercentage = availableCycles == 0 ? PERCENTAGE_MULTIPLIER : (uint32_t)((uint64_t)PERCENTAGE_MULTIPLIER * busyCycles / availableCycles);
+
+    /* Assume the busy time scales with the divider and choose the largest divider which stays within the safety margin */
+
+    uint32_t divider = 1;
+
+    while (divider < GOVERNOR_MAXIMUM_CORE_CLOCK_DIVIDER && 2 * divider * dutyCyclePercentage <= GOVERNOR_MAXIMUM_DUTY_CYCLE_PERCENTAGE) divider *= 2;
+
+    if (divider > 1) setGovernorCoreClockDivider(divider);
+
+}
+
+/* Find the longest sleep for which keeping the SD card powered uses less charge than initialising it again */
+
+static uint32_t getSDCardPowerHoldInterval(void) {
+
+    uint64_t initialisationCharge = (uint64_t)AudioMoth_getSDCardInitialisationTime() * SD_CARD_INITIALISATION_CURRENT_IN_UA;
+
+    uint32_t breakEvenInterval = initialisationCharge / SD_CARD_IDLE_CURRENT_IN_UA / MILLISECONDS_IN_SECOND;
+
+    return MIN(breakEvenInterval, MAXIMUM_SD_CARD_POWER_HOLD_INTERVAL);
+
+}
+
+/* Save the free space and volume parameters in the backup domain so later mounts need not read them from the SD card again */
+
+static void saveFileSystemState(void) {
+
+    AM_freeSpace_t currentFreeSpace;
+
+    if (!AudioMoth_getFreeSpace(&currentFreeSpace)) memset(&currentFreeSpace, 0, sizeof(AM_freeSpace_t));
+
+    copyToBackupDomain((uint32_t*)freeSpace, (uint8_t*)&currentFreeSpace, sizeof(AM_freeSpace_t));
+
+    AM_fileSystemCache_t currentFileSystemCache;
+
+    if (!AudioMoth_getFileSystemCache(&currentFileSystemCache)) memset(&currentFileSystemCache, 0, sizeof(AM_fileSystemCache_t));
+
+    copyToBackupDomain((uint32_t*)fileSystemCache, (uint8_t*)&currentFileSystemCache, sizeof(AM_fileSystemCache_t));
+
+}
+
+/* Append the profile and SD card log of the files recorded since capture started and save the file system state. This waits until capture stops so it never delays the next of back-to-back files */
+
+static void writeRecordingLogs(void) {
+
+    if (!recordingLogPending) return;
+
+    if (numberOfLoggedFiles > 1) {
+
+        sprintf(loggedFilenames, "%s to %s", firstLoggedFilename, filename);
+
+    } else {
+
+        strcpy(loggedFilenames, filename);
+
+    }
+
+    PROFILER_WRITE_SUMMARY("PROFILE.TXT", loggedFilenames, configSettings->sampleRate[loggedConfigurationIndex], configSettings->sampleRateDivider[loggedConfigurationIndex], numberOfSamplesInDMATransfer);
+
+    CardLog_writeSummary(CARD_LOG_FILENAME, loggedFilenames, bufferOverflow);
+
+    saveFileSystemState();
+
+    recordingLogPending = false;
+
+}
+
+/* Move into the folder for the current day, restoring the saved location of the folder if it has already been made */
+
+static bool enterDailyFolder(struct tm *time) {
+
+    uint32_t date = (YEAR_OFFSET + time->tm_year) * DATE_YEAR_MULTIPLIER + (MONTH_OFFSET + time->tm_mon) * DATE_MONTH_MULTIPLIER + time->tm_mday;
+
+    if (date == *dateOfDailyFolder && AudioMoth_setDirectoryLocation(dailyFolderLocation)) return true;
+
+    static char folderName[DAILY_FOLDER_NAME_LENGTH];
+
+    sprintf(folderName, "/%08lu", date);
+
+    if (!AudioMoth_doesDirectoryExist(folderName)) RETURN_BOOL_ON_ERROR(AudioMoth_makeDirectory(folderName));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_changeDirectory(folderName));
+
+    /* Save the location so later recordings on the same day skip the search of the root directory */
+
+    AM_directoryLocation_t location;
+
+    if (AudioMoth_getDirectoryLocation(&location)) {
+
+        copyToBackupDomain((uint32_t*)dailyFolderLocation, (uint8_t*)&location, sizeof(AM_directoryLocation_t));
+
+        *dateOfDailyFolder = date;
+
+    }
+
+    return true;
+
+}
+
+/* Write the vectors as separate transfers which each end at or before a write unit boundary */
+
+static bool writeVectorsWithinWriteUnits(AM_fileVector_t *vectors, uint32_t numberOfVectors, uint32_t writeUnitSize, uint32_t bytesWrittenToFile) {
+
+    AM_fileVector_t unitVectors[3];
+
+    uint32_t numberOfUnitVectors = 0;
+
+    uint32_t bytesRemainingInUnit = writeUnitSize - bytesWrittenToFile % writeUnitSize;
+
+    for (uint32_t i = 0; i < numberOfVectors; i += 1) {
+
+        uint8_t *bytes = vectors[i].bytes;
+
+        uint32_t numberOfBytes = vectors[i].numberOfBytes;
+
+        while (numberOfBytes > 0) {
+
+            uint32_t numberOfBytesInPiece = MIN(numberOfBytes, bytesRemainingInUnit);
+
+            unitVectors[numberOfUnitVectors] = (AM_fileVector_t){bytes, numberOfBytesInPiece};
+
+            numberOfUnitVectors += 1;
+
+            bytes += numberOfBytesInPiece;
+
+            numberOfBytes -= numberOfBytesInPiece;
+
+            bytesRemainingInUnit -= numberOfBytesInPiece;
+
+            if (bytesRemainingInUnit == 0 || numberOfUnitVectors == 3) {
+
+                RETURN_BOOL_ON_ERROR(AudioMoth_writeToFileV(unitVectors, numberOfUnitVectors));
+
+                numberOfUnitVectors = 0;
+
+                if (bytesRemainingInUnit == 0) bytesRemainingInUnit = writeUnitSize;
+
+            }
+
+        }
+
+    }
+
+    if (numberOfUnitVectors > 0) RETURN_BOOL_ON_ERROR(AudioMoth_writeToFileV(unitVectors, numberOfUnitVectors));
+
+    return true;
+
+}
+
+/* Save recording to SD card */
+
+static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDuration, bool enableLED, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature) {
+
+    /* Calculate effective sample rate */
+
+    uint32_t effectiveSampleRate = configSettings->sampleRate[*configurationIndexOfNextRecording] / configSettings->sampleRateDivider[*configurationIndexOfNextRecording];
+
+    /* Set up the sample pipeline unless it is still running from the previous recording */
+
+    bool followsPreviousRecording = captureRunning;
 
-        } else if (event == AC_EVENT_BIT_ERROR || event == AC_EVENT_CRC_ERROR) {
+    if (!followsPreviousRecording) {
 
-            audioConfigStateLED = false;
+        /* Initialise buffers */
 
-        }
+        writeBuffer = 0;
 
-        AudioMoth_setGreenLED((audioConfigStateLED && audioConfigToggleLED) || (!audioConfigStateLED && !audioConfigPulseCounter));
+        writeBufferIndex = 0;
 
-    }
+        readBuffer = 0;
 
-}
+        readBufferIndex = 0;
 
-void AudioConfig_handleAudioConfigurationPacket(uint8_t *receiveBuffer, uint32_t size) {
+        bufferOverflow = false;
 
-    uint32_t standardPacketSize = UINT32_SIZE_IN_BYTES + UINT16_SIZE_IN_BYTES;
+        buffers[0] = (int16_t*)AM_EXTERNAL_SRAM_START_ADDRESS;
 
-    bool standardPacket = size == standardPacketSize;
+        for (uint32_t i = 1; i < NUMBER_OF_BUFFERS; i += 1) {
+            buffers[i] = buffers[i - 1] + NUMBER_OF_SAMPLES_IN_BUFFER;
+        }
 
-    bool hasLocation = size == standardPacketSize + ACOUSTIC_LOCATION_SIZE_IN_BYTES;
+        /* Set up the digital filter */
 
-    if (AudioMoth_hasTimeBeenSet() == false && (standardPacket || hasLocation)) {
+        if (configSettings->lowerFilterFreq[*configurationIndexOfNextRecording] == 0 && configSettings->higherFilterFreq[*configurationIndexOfNextRecording] == 0) {
 
-        uint32_t time;
+            requestedFilterType = NO_FILTER;
 
-        memcpy(&time, receiveBuffer, UINT32_SIZE_IN_BYTES);
+            DigitalFilter_designHighPassFilter(effectiveSampleRate, DC_BLOCKING_FREQ);
 
-        AudioMoth_setTime(time + AUDIO_CONFIG_TIME_CORRECTION, 0);
+        } else if (configSettings->lowerFilterFreq[*configurationIndexOfNextRecording] == UINT16_MAX) {
 
-        AudioMoth_setGreenLED(true);
+            requestedFilterType = LOW_PASS_FILTER;
 
-        if (hasLocation) {
+            DigitalFilter_designBandPassFilter(effectiveSampleRate, DC_BLOCKING_FREQ, FILTER_FREQ_MULTIPLIER * configSettings->higherFilterFreq[*configurationIndexOfNextRecording]);
 
-            acousticLocation_t location;
+        } else if (configSettings->higherFilterFreq[*configurationIndexOfNextRecording] == UINT16_MAX) {
 
-            memcpy(&location, receiveBuffer + standardPacketSize, ACOUSTIC_LOCATION_SIZE_IN_BYTES);
+            requestedFilterType = HIGH_PASS_FILTER;
 
-            *acousticLocationReceived = true;
+            DigitalFilter_designHighPassFilter(effectiveSampleRate, MAX(DC_BLOCKING_FREQ, FILTER_FREQ_MULTIPLIER * configSettings->lowerFilterFreq[*configurationIndexOfNextRecording]));
 
-            *acousticLatitude = location.latitude;
-            
-            *acousticLongitude = location.longitude * ACOUSTIC_LONGITUDE_MULTIPLIER;
+        } else {
 
-        }
+            requestedFilterType = BAND_PASS_FILTER;
 
-    }
+            DigitalFilter_designBandPassFilter(effectiveSampleRate, MAX(DC_BLOCKING_FREQ, FILTER_FREQ_MULTIPLIER * configSettings->lowerFilterFreq[*configurationIndexOfNextRecording]), FILTER_FREQ_MULTIPLIER * configSettings->higherFilterFreq[*configurationIndexOfNextRecording]);
 
-    /* Reset receive state */
+        }
 
-    audioConfigStateLED = false;
+        /* Use the cheapest calibrated ADC settings for this sample rate unless energy saver mode has changed the ADC clock */
 
-    audioConfigPulseCounter = 0;
+        adcSettings.clockDivider = configSettings->clockDivider[*configurationIndexOfNextRecording];
 
-}
+        adcSettings.acquisitionCycles = configSettings->acquisitionCycles;
 
-/* Encode the compression buffer */
+        adcSettings.oversampleRate = configSettings->oversampleRate;
 
-static void encodeCompressionBuffer(uint32_t numberOfCompressedBuffers) {
+        if (!configSettings->enableEnergySaverMode[*configurationIndexOfNextRecording]) ADCTuner_getSettings(configSettings->sampleRate[*configurationIndexOfNextRecording], &adcSettings);
 
-    for (uint32_t i = 0; i < UINT32_SIZE_IN_BITS; i += 1) {
+        /* Calculate the sample multiplier */
 
-        compressionBuffer[i] = numberOfCompressedBuffers & 0x01 ? 1 : -1;
+        float sampleMultiplier = 16.0f / (float)(adcSettings.oversampleRate * configSettings->sampleRateDivider[*configurationIndexOfNextRecording]);
 
-        numberOfCompressedBuffers >>= 1;
+        DigitalFilter_applyAdditionalGain(sampleMultiplier);
 
-    }
+        /* Capture directly into the SRAM buffers if the samples need no processing. DC offset is then reported rather than removed */
 
-    for (uint32_t i = UINT32_SIZE_IN_BITS; i < COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE; i += 1) {
+        rawCaptureEnabled = requestedFilterType == NO_FILTER && configSettings->sampleRateDivider[*configurationIndexOfNextRecording] == 1 && adcSettings.oversampleRate == 1 && configSettings->amplitudeThreshold[*configurationIndexOfNextRecording] == 0;
 
-        compressionBuffer[i] = 0;
+        rawCaptureIndex = 0;
 
-    }
+        rawCaptureOffset = 0;
 
-}
+        /* Calculate the number of samples in each DMA transfer */
 
-/* Save recording to SD card */
+        numberOfSamplesInDMATransfer = calculateSamplesInDMATransfer(configSettings->sampleRateDivider[*configurationIndexOfNextRecording]);
 
-static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDuration, bool enableLED, AM_extendedBatteryState_t extendedBatteryState, int32_t temperature) {
+#ifdef AM_ENABLE_CHAINED_DMA
 
-    /* Initialise buffers */
+        /* Raw capture transfers are not limited by the internal DMA buffers and use chained descriptors */
 
-    writeBuffer = 0;
+        if (rawCaptureEnabled) numberOfSamplesInDMATransfer = SAMPLES_IN_RAW_CAPTURE_DMA_TRANSFER;
 
-    writeBufferIndex = 0;
+#endif
 
-    buffers[0] = (int16_t*)AM_EXTERNAL_SRAM_START_ADDRESS;
+        /* Set up the DMA transfers to skip */
 
-    for (uint32_t i = 1; i < NUMBER_OF_BUFFERS; i += 1) {
-        buffers[i] = buffers[i - 1] + NUMBER_OF_SAMPLES_IN_BUFFER;
-    }
+        dmaTransfersProcessed = 0;
 
-    /* Calculate effective sample rate */
+        dmaTransfersToSkip = configSettings->sampleRate[*configurationIndexOfNextRecording] / FRACTION_OF_SECOND_FOR_WARMUP / numberOfSamplesInDMATransfer;
 
-    uint32_t effectiveSampleRate = configSettings->sampleRate[*configurationIndexOfNextRecording] / configSettings->sampleRateDivider[*configurationIndexOfNextRecording];
+        minimumDMATransfersToSkip = configSettings->sampleRate[*configurationIndexOfNextRecording] / FRACTION_OF_SECOND_FOR_MINIMUM_WARMUP / numberOfSamplesInDMATransfer;
 
-    /* Set up the digital filter */
+        warmupSettledTransfers = 0;
 
-    if (configSettings->lowerFilterFreq[*configurationIndexOfNextRecording] == 0 && configSettings->higherFilterFreq[*configurationIndexOfNextRecording] == 0) {
+    }
 
-        requestedFilterType = NO_FILTER;
+    /* Calculate recording parameters. A block file starts with a file header block and its samples are not part of the header */
 
-        DigitalFilter_designHighPassFilter(effectiveSampleRate, DC_BLOCKING_FREQ);
+    bool adpcmEncoding = configSettings->enableADPCM[*configurationIndexOfNextRecording];
 
-    } else if (configSettings->lowerFilterFreq[*configurationIndexOfNextRecording] == UINT16_MAX) {
+    bool blockFileFormat = configSettings->enableProprietaryFileFormat && !adpcmEncoding;
 
-        requestedFilterType = LOW_PASS_FILTER;
+    bool losslessCompression = blockFileFormat && configSettings->enableProprietaryFileFormat == LOSSLESS_BLOCK_FILE_FORMAT;
 
-        DigitalFilter_designBandPassFilter(effectiveSampleRate, DC_BLOCKING_FREQ, FILTER_FREQ_MULTIPLIER * configSettings->higherFilterFreq[*configurationIndexOfNextRecording]);
+    uint32_t numberOfBytesInHeader = blockFileFormat ? BF_SECTOR_SIZE : sizeof(wavHeader);
 
-    } else if (configSettings->higherFilterFreq[*configurationIndexOfNextRecording] == UINT16_MAX) {
+    uint32_t numberOfSamplesInHeader = blockFileFormat || adpcmEncoding ? 0 : numberOfBytesInHeader / NUMBER_OF_BYTES_IN_SAMPLE;
 
-        requestedFilterType = HIGH_PASS_FILTER;
+    uint32_t numberOfBytesInOverhead = blockFileFormat ? BLOCK_FILE_OVERHEAD_IN_BYTES : 0;
 
-        DigitalFilter_designHighPassFilter(effectiveSampleRate, MAX(DC_BLOCKING_FREQ, FILTER_FREQ_MULTIPLIER * configSettings->lowerFilterFreq[*configurationIndexOfNextRecording]));
+    uint32_t numberOfBytesInBuffer = NUMBER_OF_BYTES_IN_SAMPLE * NUMBER_OF_SAMPLES_IN_BUFFER + (blockFileFormat ? BLOCK_FILE_BUFFER_OVERHEAD_IN_BYTES : 0);
 
-    } else {
+    if (adpcmEncoding) numberOfBytesInBuffer = ADPCM_getNumberOfBytes(NUMBER_OF_SAMPLES_IN_BUFFER) + ADPCM_BLOCK_SIZE;
 
-        requestedFilterType = BAND_PASS_FILTER;
+    uint32_t maximumNumberOfSeconds = (uint64_t)(MAXIMUM_WAV_FILE_SIZE - numberOfBytesInHeader - numberOfBytesInOverhead) * NUMBER_OF_SAMPLES_IN_BUFFER / numberOfBytesInBuffer / effectiveSampleRate;
 
-        DigitalFilter_designBandPassFilter(effectiveSampleRate, MAX(DC_BLOCKING_FREQ, FILTER_FREQ_MULTIPLIER * configSettings->lowerFilterFreq[*configurationIndexOfNextRecording]), FILTER_FREQ_MULTIPLIER * configSettings->higherFilterFreq[*configurationIndexOfNextRecording]);
+    bool fileSizeLimited = (recordDuration > maximumNumberOfSeconds);
 
-    }
+    recordedDuration = fileSizeLimited ? maximumNumberOfSeconds : recordDuration;
 
-    /* Calculate the sample multiplier */
+    /* Shorten the recording so that it fits in the free space and can be completed with a valid header */
 
-    float sampleMultiplier = 16.0f / (float)(configSettings->oversampleRate * configSettings->sampleRateDivider[*configurationIndexOfNextRecording]);
+    if (!followsPreviousRecording) AudioMoth_restoreFreeSpace(freeSpace);
 
-    DigitalFilter_applyAdditionalGain(sampleMultiplier);
+    bool sdCardFull = false;
 
-    /* Calculate the number of samples in each DMA transfer */
+    AM_freeSpace_t availableSpace;
 
-    numberOfSamplesInDMATransfer = MAXIMUM_SAMPLES_IN_DMA_TRANSFER / configSettings->sampleRateDivider[*configurationIndexOfNextRecording];
+    if (AudioMoth_getFreeSpace(&availableSpace)) {
 
-    while (numberOfSamplesInDMATransfer & (numberOfSamplesInDMATransfer - 1)) {
+        uint64_t availableBytes = (uint64_t)availableSpace.clusterSize * (availableSpace.freeClusters > FREE_SPACE_RESERVED_CLUSTERS ? availableSpace.freeClusters - FREE_SPACE_RESERVED_CLUSTERS : 0);
 
-        numberOfSamplesInDMATransfer = numberOfSamplesInDMATransfer & (numberOfSamplesInDMATransfer - 1);
+        uint64_t reservedBytes = numberOfBytesInHeader + COMPRESSION_BUFFER_SIZE_IN_BYTES + numberOfBytesInOverhead;
 
-    }
+        uint32_t numberOfSecondsInFreeSpace = availableBytes > reservedBytes ? (availableBytes - reservedBytes) * NUMBER_OF_SAMPLES_IN_BUFFER / numberOfBytesInBuffer / effectiveSampleRate : 0;
 
-    numberOfSamplesInDMATransfer *= configSettings->sampleRateDivider[*configurationIndexOfNextRecording];
+        if (recordedDuration > numberOfSecondsInFreeSpace) {
 
-    /* Set up the DMA transfers to skip */
+            recordedDuration = numberOfSecondsInFreeSpace;
 
-    dmaTransfersProcessed = 0;
+            fileSizeLimited = false;
 
-    dmaTransfersToSkip = configSettings->sampleRate[*configurationIndexOfNextRecording] / FRACTION_OF_SECOND_FOR_WARMUP / numberOfSamplesInDMATransfer;
+            sdCardFull = true;
 
-    /* Calculate recording parameters */
+        }
 
-    uint32_t numberOfBytesInHeader = sizeof(wavHeader);
+    }
 
-    uint32_t numberOfSamplesInHeader = numberOfBytesInHeader / NUMBER_OF_BYTES_IN_SAMPLE;
+    if (recordedDuration == 0) return SDCARD_FULL;
 
-    uint32_t maximumNumberOfSeconds = (MAXIMUM_WAV_FILE_SIZE - numberOfBytesInHeader) / NUMBER_OF_BYTES_IN_SAMPLE / effectiveSampleRate;
+    uint32_t numberOfSamples = effectiveSampleRate * recordedDuration;
 
-    bool fileSizeLimited = (recordDuration > maximumNumberOfSeconds);
+    /* Every block payload fills whole sectors so it is written directly from the buffers */
 
-    uint32_t numberOfSamples = effectiveSampleRate * (fileSizeLimited ? maximumNumberOfSeconds : recordDuration);
+    if (blockFileFormat) numberOfSamples -= numberOfSamples % (BF_SECTOR_SIZE / NUMBER_OF_BYTES_IN_SAMPLE);
 
     /* Reset total buffers written today */
 
@@ -1180,37 +2244,141 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
     if (*configurationIndexOfNextRecording == OPPORTUNISTIC_RECORDING && *totalFileSizeWritten > maximumFileSizeWritten) return TOTAL_FILE_SIZE_LIMITED;
 
-    /* Initialise microphone for recording */
+    /* Start the statistics for a new recording */
 
-    AudioMoth_enableExternalSRAM();
+    if (!followsPreviousRecording) {
 
-    AudioMoth_enableMicrophone(AM_NORMAL_GAIN_RANGE, configSettings->gain[*configurationIndexOfNextRecording], configSettings->clockDivider[*configurationIndexOfNextRecording], configSettings->acquisitionCycles, configSettings->oversampleRate);
+        PROFILER_RESET();
 
-    AudioMoth_initialiseDirectMemoryAccess(primaryBuffer, secondaryBuffer, numberOfSamplesInDMATransfer);
+        CardLog_reset();
 
-    AudioMoth_startMicrophoneSamples(configSettings->sampleRate[*configurationIndexOfNextRecording]);
+        AudioMoth_enableExternalSRAM();
+
+        AudioMoth_enableCycleCounter();
+
+    }
+
+    /* Each file keeps its own SD card statistics for its GUANO data */
+
+    if (followsPreviousRecording) CardLog_startNextFile();
 
     /* Show LED for SD card activity */
    
     if (enableLED) AudioMoth_setRedLED(true);
 
-    /* Open a file with the current local time as the name */
+    /* Open a file with the current local time as the name, in the folder for the day if enabled */
+
+    if (configSettings->enableDailyFolders) FLASH_LED_AND_RETURN_ON_ERROR(enterDailyFolder(time));
 
     uint32_t length = sprintf(filename, "%04d%02d%02d_%02d%02d%02d", YEAR_OFFSET + time->tm_year, MONTH_OFFSET + time->tm_mon, time->tm_mday, time->tm_hour, time->tm_min, time->tm_sec);
 
-    static char *extensions[4] = {".WAV", "T.WAV"};
+    static char *extensions[4] = {".WAV", "T.WAV", ".DAT", "T.DAT"};
 
-    uint32_t extensionIndex = configSettings->amplitudeThreshold[*configurationIndexOfNextRecording] > 0 ? 1 : 0;
+    uint32_t extensionIndex = (blockFileFormat ? 2 : 0) + (configSettings->amplitudeThreshold[*configurationIndexOfNextRecording] > 0 ? 1 : 0);
 
     strcpy(filename + length, extensions[extensionIndex]);
 
     FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_openFile(filename));
 
+    /* Allocate the file in one contiguous block before the microphone starts. A file which follows on while the microphone is running only allocates its start and the file system extends it as it is written, as it does when there is no contiguous space */
+
+    uint32_t numberOfBlockFileBuffers = blockFileFormat ? (numberOfSamples + NUMBER_OF_SAMPLES_IN_BUFFER - 1) / NUMBER_OF_SAMPLES_IN_BUFFER : 0;
+
+    uint32_t numberOfBytesOfSamples = adpcmEncoding ? ADPCM_getNumberOfBytes(numberOfSamples) : NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamples;
+
+    uint32_t numberOfBytesToAllocate = numberOfBytesInHeader + numberOfBytesOfSamples + COMPRESSION_BUFFER_SIZE_IN_BYTES + numberOfBytesInOverhead + numberOfBlockFileBuffers * BLOCK_FILE_BUFFER_OVERHEAD_IN_BYTES;
+
+    if (followsPreviousRecording) numberOfBytesToAllocate = MIN(numberOfBytesToAllocate, MAXIMUM_PREALLOCATION_WHILE_CAPTURING);
+
+    AudioMoth_expandFile(numberOfBytesToAllocate);
+
+    /* Initialise microphone for recording. The filter benchmark of a profiling build runs first so the DMA interrupt cannot disturb it */
+
+    if (!followsPreviousRecording) {
+
+        PROFILER_BENCHMARK_FILTER(primaryBuffer, numberOfSamplesInDMATransfer, configSettings->sampleRateDivider[*configurationIndexOfNextRecording]);
+
+        AudioMoth_enableMicrophone(AM_NORMAL_GAIN_RANGE, configSettings->gain[*configurationIndexOfNextRecording], adcSettings.clockDivider, adcSettings.acquisitionCycles, adcSettings.oversampleRate);
+
+        if (rawCaptureEnabled) {
+
+            AudioMoth_setMicrophoneLeftAdjust(true);
+
+            AudioMoth_initialiseDirectMemoryAccess(buffers[0], buffers[0] + numberOfSamplesInDMATransfer, numberOfSamplesInDMATransfer);
+
+        } else {
+
+            AudioMoth_initialiseDirectMemoryAccess(primaryBuffer, secondaryBuffer, numberOfSamplesInDMATransfer);
+
+        }
+
+        AudioMoth_startMicrophoneSamples(configSettings->sampleRate[*configurationIndexOfNextRecording]);
+
+        captureRunning = true;
+
+    }
+
+    /* A file which follows on from the previous recording keeps every sample so space is left for the header */
+
+    uint32_t samplesWritten = 0;
+
+    uint32_t bytesWrittenToFile = 0;
+
+    uint32_t blockSequenceNumber = 1;
+
+    uint32_t blockTime, blockMilliseconds;
+
+    if (blockFileFormat) {
+
+        /* The block file header is complete when the file is opened so it is never rewritten */
+
+        BF_fileDescription_t fileDescription = {
+            .version = BF_FILE_VERSION,
+            .sampleRate = effectiveSampleRate,
+            .startTime = currentTime,
+            .timezoneOffset = configSettings->timezoneHours * SECONDS_IN_HOUR + configSettings->timezoneMinutes * SECONDS_IN_MINUTE,
+            .serialNumber = {*(uint32_t*)AM_UNIQUE_ID_START_ADDRESS, *((uint32_t*)AM_UNIQUE_ID_START_ADDRESS + 1)},
+            .numberOfChannels = 1,
+            .bitsPerSample = 16
+        };
+
+        BlockFile_setFileHeader(blockHeader, currentTime, 0, &fileDescription);
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(blockHeader, BF_SECTOR_SIZE));
+
+        bytesWrittenToFile = BF_SECTOR_SIZE;
+
+    } else if (adpcmEncoding) {
+
+        /* No samples are given up to the header as the encoded stream starts after it. The partial blocks use buffers the WAV format does not otherwise need */
+
+        ADPCM_reset((uint8_t*)compressionBuffer, blockHeader);
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(&adpcmWavHeader, sizeof(adpcmWavHeader)));
+
+        bytesWrittenToFile = numberOfBytesInHeader;
+
+    } else if (followsPreviousRecording) {
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(&wavHeader, sizeof(wavHeader)));
+
+        samplesWritten = numberOfSamplesInHeader;
+
+        bytesWrittenToFile = numberOfBytesInHeader;
+
+    }
+
+    /* Writes are split so that none crosses a boundary of the card's allocation unit. If that is unknown a write is only limited by the ring */
+
+    uint32_t writeUnitSize = AudioMoth_getSDCardAllocationUnitSize();
+
+    if (writeUnitSize == 0) writeUnitSize = NUMBER_OF_BYTES_IN_SAMPLE * EXTERNAL_SRAM_SIZE_IN_SAMPLES;
+
     AudioMoth_setRedLED(false);
 
-    /* Termination conditions */
+    /* Termination conditions. A switch change while the previous file was being closed is kept */
 
-    switchPositionChanged = false;
+    if (!followsPreviousRecording) switchPositionChanged = false;
 
     bool supplyVoltageLow = false;
 
@@ -1218,10 +2386,6 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
     /* Main record loop */
 
-    uint32_t readBuffer = 0;
-
-    uint32_t samplesWritten = 0;
-
     uint32_t buffersProcessed = 0;
 
     uint32_t numberOfCompressedBuffers = 0;
@@ -1230,19 +2394,27 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
     /* Ensure main loop doesn't start if the last buffer is currently being written to */
 
-    while (writeBuffer == NUMBER_OF_BUFFERS - 1) { }
+    if (!followsPreviousRecording) {
+
+        while (writeBuffer == NUMBER_OF_BUFFERS - 1) { }
+
+    }
+
+    /* Start measuring the load to choose the core clock */
+
+    startClockGovernor();
 
     /* Main recording loop */
 
-    while (samplesWritten < numberOfSamples + numberOfSamplesInHeader && !switchPositionChanged && !supplyVoltageLow && !totalFileSizeLimited) {
+    while (samplesWritten < numberOfSamples + numberOfSamplesInHeader && !switchPositionChanged && !supplyVoltageLow && !totalFileSizeLimited && !bufferOverflow) {
 
-        while (readBuffer != writeBuffer && samplesWritten < numberOfSamples + numberOfSamplesInHeader && !switchPositionChanged && !supplyVoltageLow && !totalFileSizeLimited) {
+        while (readBuffer != writeBuffer && samplesWritten < numberOfSamples + numberOfSamplesInHeader && !switchPositionChanged && !supplyVoltageLow && !totalFileSizeLimited && !bufferOverflow) {
 
             /* Write the appropriate number of bytes to the SD card */
 
-            uint32_t numberOfSamplesToWrite = MIN(numberOfSamples + numberOfSamplesInHeader - samplesWritten, NUMBER_OF_SAMPLES_IN_BUFFER);
+            uint32_t numberOfSamplesToWrite = MIN(numberOfSamples + numberOfSamplesInHeader - samplesWritten, NUMBER_OF_SAMPLES_IN_BUFFER - readBufferIndex);
 
-            if (!writeIndicator[readBuffer] && buffersProcessed > 0 && numberOfSamplesToWrite == NUMBER_OF_SAMPLES_IN_BUFFER) {
+            if (!adpcmEncoding && !writeIndicator[readBuffer] && buffersProcessed > 0 && numberOfSamplesToWrite == NUMBER_OF_SAMPLES_IN_BUFFER) {
 
                 numberOfCompressedBuffers += NUMBER_OF_BYTES_IN_SAMPLE * NUMBER_OF_SAMPLES_IN_BUFFER / COMPRESSION_BUFFER_SIZE_IN_BYTES;
 
@@ -1252,15 +2424,43 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
                 if (enableLED) AudioMoth_setRedLED(true);
 
-                /* Encode and write compression buffer */
+                /* Encode the compression buffer and write it in the same transfer as the buffer which follows it */
+
+                AM_fileVector_t vectors[3];
+
+                uint32_t numberOfVectors = 0;
+
+                if (blockFileFormat) AudioMoth_getTime(&blockTime, &blockMilliseconds);
 
                 if (numberOfCompressedBuffers > 0) {
 
-                    encodeCompressionBuffer(numberOfCompressedBuffers);
+                    if (blockFileFormat) {
+
+                        /* A silent run becomes a block with no payload */
+
+                        uint32_t numberOfSilentSamples = numberOfCompressedBuffers * COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE;
+
+                        BlockFile_setSilenceBlock((uint8_t*)compressionBuffer, blockSequenceNumber, samplesWritten - numberOfSilentSamples, numberOfSilentSamples, blockTime, blockMilliseconds);
+
+                        blockSequenceNumber += 1;
+
+                    } else {
+
+                        PROFILER_START(encodeStart);
+
+                        encodeCompressionBuffer(numberOfCompressedBuffers);
 
-                    totalNumberOfCompressedSamples += (numberOfCompressedBuffers - 1) * COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE;
+                        PROFILER_STOP(encodeStart, PR_ENCODE_COMPRESSION_BUFFER);
 
-                    FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(compressionBuffer, COMPRESSION_BUFFER_SIZE_IN_BYTES));
+                        totalNumberOfCompressedSamples += (numberOfCompressedBuffers - 1) * COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE;
+
+                    }
+
+                    vectors[numberOfVectors] = (AM_fileVector_t){compressionBuffer, COMPRESSION_BUFFER_SIZE_IN_BYTES};
+
+                    numberOfVectors += 1;
+
+                    bytesWrittenToFile += COMPRESSION_BUFFER_SIZE_IN_BYTES;
 
                     if (*configurationIndexOfNextRecording == OPPORTUNISTIC_RECORDING) *totalFileSizeWritten += COMPRESSION_BUFFER_SIZE_IN_BYTES / TOTAL_FILE_SIZE_UNITS_IN_BYTES;
 
@@ -1268,11 +2468,135 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
                 }
 
-                /* Write the buffer */
+                /* Leave space for the block header which goes in the same transfer as its samples */
+
+                if (blockFileFormat) {
+
+                    vectors[numberOfVectors] = (AM_fileVector_t){blockHeader, BF_SECTOR_SIZE};
+
+                    numberOfVectors += 1;
+
+                    bytesWrittenToFile += BF_SECTOR_SIZE;
+
+                    if (*configurationIndexOfNextRecording == OPPORTUNISTIC_RECORDING) *totalFileSizeWritten += BF_SECTOR_SIZE / TOTAL_FILE_SIZE_UNITS_IN_BYTES;
+
+                }
+
+                /* Add the following buffers which are already full, are not silent and do not wrap round the ring, as they are contiguous in memory */
+
+                uint32_t numberOfBuffersInBurst = 1;
+
+                while (readBuffer + numberOfBuffersInBurst < NUMBER_OF_BUFFERS && readBuffer + numberOfBuffersInBurst != writeBuffer && writeIndicator[readBuffer + numberOfBuffersInBurst]) numberOfBuffersInBurst += 1;
+
+                numberOfSamplesToWrite = MIN(numberOfSamples + numberOfSamplesInHeader - samplesWritten, numberOfBuffersInBurst * NUMBER_OF_SAMPLES_IN_BUFFER - readBufferIndex);
+
+                /* Stop at the next write unit boundary. The rest is written on the next pass. ADPCM output is split at the boundary instead as its size is not known in advance */
+
+                if (!adpcmEncoding) numberOfSamplesToWrite = MIN(numberOfSamplesToWrite, (writeUnitSize - bytesWrittenToFile % writeUnitSize) / NUMBER_OF_BYTES_IN_SAMPLE);
+
+                /* Write the buffer once the last copy into it has completed */
+
+                while (AudioMoth_isMemoryCopyInProgress()) { }
+
+                /* Compressed samples are written back over the start of the buffers and are never larger than the samples, so no write unit boundary is crossed. ADPCM output may also include a block completed from the previous burst */
+
+                uint32_t numberOfBytesToWrite = NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesToWrite;
+
+                if (adpcmEncoding) {
+
+                    /* Silent buffers are encoded as silence as the WAV format has no marker for them */
+
+                    int16_t *samples = buffers[readBuffer] + readBufferIndex;
+
+                    if (!writeIndicator[readBuffer] && buffersProcessed > 0) memset(samples, 0, NUMBER_OF_BYTES_IN_SAMPLE * MIN(numberOfSamplesToWrite, NUMBER_OF_SAMPLES_IN_BUFFER - readBufferIndex));
+
+                    uint8_t *completedBlock;
+
+                    PROFILER_START(adpcmStart);
+
+                    uint32_t numberOfBytes = ADPCM_encode(samples, numberOfSamplesToWrite, &completedBlock);
+
+                    PROFILER_STOP(adpcmStart, PR_ADPCM_ENCODE);
+
+                    numberOfBytesToWrite = 0;
+
+                    if (completedBlock != NULL) {
+
+                        vectors[numberOfVectors] = (AM_fileVector_t){completedBlock, ADPCM_BLOCK_SIZE};
+
+                        numberOfVectors += 1;
+
+                        numberOfBytesToWrite += ADPCM_BLOCK_SIZE;
+
+                    }
+
+                    if (numberOfBytes > 0) {
+
+                        vectors[numberOfVectors] = (AM_fileVector_t){samples, numberOfBytes};
+
+                        numberOfVectors += 1;
+
+                        numberOfBytesToWrite += numberOfBytes;
+
+                    }
+
+                } else if (losslessCompression) {
+
+                    numberOfSamplesToWrite = MIN(numberOfSamplesToWrite, LL_MAXIMUM_NUMBER_OF_SAMPLES);
+
+                    uint32_t peakLevel;
+
+                    PROFILER_START(losslessStart);
+
+                    uint32_t numberOfBytes = Lossless_encode(buffers[readBuffer] + readBufferIndex, numberOfSamplesToWrite, frameSizes, &peakLevel);
+
+                    PROFILER_STOP(losslessStart, PR_LOSSLESS_ENCODE);
+
+                    BlockFile_setCompressedAudioBlock(blockHeader, blockSequenceNumber, samplesWritten, (uint8_t*)(buffers[readBuffer] + readBufferIndex), numberOfBytes, frameSizes, Lossless_getNumberOfFrames(numberOfSamplesToWrite), numberOfSamplesToWrite, peakLevel, writeIndicator[readBuffer], blockTime, blockMilliseconds);
+
+                    blockSequenceNumber += 1;
+
+                    numberOfBytesToWrite = ROUND_UP_TO_MULTIPLE(numberOfBytes, BF_SECTOR_SIZE);
+
+                } else if (blockFileFormat) {
+
+                    PROFILER_START(blockHeaderStart);
+
+                    BlockFile_setAudioBlock(blockHeader, blockSequenceNumber, samplesWritten, buffers[readBuffer] + readBufferIndex, numberOfSamplesToWrite, writeIndicator[readBuffer], blockTime, blockMilliseconds);
+
+                    PROFILER_STOP(blockHeaderStart, PR_ENCODE_BLOCK_HEADER);
+
+                    blockSequenceNumber += 1;
+
+                }
+
+                if (!adpcmEncoding) {
+
+                    vectors[numberOfVectors] = (AM_fileVector_t){buffers[readBuffer] + readBufferIndex, numberOfBytesToWrite};
+
+                    numberOfVectors += 1;
+
+                }
+
+                PROFILER_START(writeStart);
+
+                if (adpcmEncoding) {
+
+                    FLASH_LED_AND_RETURN_ON_ERROR(writeVectorsWithinWriteUnits(vectors, numberOfVectors, writeUnitSize, bytesWrittenToFile));
+
+                } else {
+
+                    FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFileV(vectors, numberOfVectors));
+
+                }
+
+                PROFILER_STOP(writeStart, PR_WRITE_TO_FILE);
 
-                FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(buffers[readBuffer], NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesToWrite));
+                PROFILER_ADD_BURST(vectors, numberOfVectors);
 
-                if (*configurationIndexOfNextRecording == OPPORTUNISTIC_RECORDING) *totalFileSizeWritten += NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesToWrite / TOTAL_FILE_SIZE_UNITS_IN_BYTES;
+                bytesWrittenToFile += numberOfBytesToWrite;
+
+                if (*configurationIndexOfNextRecording == OPPORTUNISTIC_RECORDING) *totalFileSizeWritten += numberOfBytesToWrite / TOTAL_FILE_SIZE_UNITS_IN_BYTES;
 
                 /* Clear LED */
 
@@ -1280,9 +2604,13 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
             }
 
-            /* Increment buffer counters */
+            /* Increment buffer counters past every buffer in the burst. The rest of a partly written buffer starts the next back-to-back file */
+
+            readBufferIndex += numberOfSamplesToWrite;
 
-            readBuffer = (readBuffer + 1) & (NUMBER_OF_BUFFERS - 1);
+            readBuffer = (readBuffer + readBufferIndex / NUMBER_OF_SAMPLES_IN_BUFFER) & (NUMBER_OF_BUFFERS - 1);
+
+            readBufferIndex %= NUMBER_OF_SAMPLES_IN_BUFFER;
 
             samplesWritten += numberOfSamplesToWrite;
 
@@ -1302,12 +2630,24 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
         }
 
+        /* Update the core clock from the measured load and the number of buffers waiting to be written */
+
+        updateClockGovernor((writeBuffer - readBuffer) & (NUMBER_OF_BUFFERS - 1));
+
         /* Sleep until next DMA transfer is complete */
 
+        PROFILER_START_SLEEP();
+
         AudioMoth_sleep();
 
+        PROFILER_STOP_SLEEP();
+
     }
 
+    /* Samples written before an overflow are intact. An overflow after this point only affects the next file */
+
+    bool bufferOverflowed = bufferOverflow;
+
     /* Write the compression buffer files at the end */
 
     if (samplesWritten < numberOfSamples + numberOfSamplesInHeader && numberOfCompressedBuffers > 0) {
@@ -1318,9 +2658,23 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
         /* Encode and write compression buffer */
 
-        encodeCompressionBuffer(numberOfCompressedBuffers);
+        if (blockFileFormat) {
+
+            uint32_t numberOfSilentSamples = numberOfCompressedBuffers * COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE;
 
-        totalNumberOfCompressedSamples += (numberOfCompressedBuffers - 1) * COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE;
+            AudioMoth_getTime(&blockTime, &blockMilliseconds);
+
+            BlockFile_setSilenceBlock((uint8_t*)compressionBuffer, blockSequenceNumber, samplesWritten - numberOfSilentSamples, numberOfSilentSamples, blockTime, blockMilliseconds);
+
+            blockSequenceNumber += 1;
+
+        } else {
+
+            encodeCompressionBuffer(numberOfCompressedBuffers);
+
+            totalNumberOfCompressedSamples += (numberOfCompressedBuffers - 1) * COMPRESSION_BUFFER_SIZE_IN_BYTES / NUMBER_OF_BYTES_IN_SAMPLE;
+
+        }
 
         FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(compressionBuffer, COMPRESSION_BUFFER_SIZE_IN_BYTES));
 
@@ -1332,11 +2686,35 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
     }
 
-    /* Write the GUANO data */
+    /* Write the last partly filled ADPCM block */
+
+    uint8_t *lastADPCMBlock = adpcmEncoding ? ADPCM_flush() : NULL;
+
+    if (lastADPCMBlock != NULL) {
+
+        if (enableLED) AudioMoth_setRedLED(true);
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(lastADPCMBlock, ADPCM_BLOCK_SIZE));
+
+        if (*configurationIndexOfNextRecording == OPPORTUNISTIC_RECORDING) *totalFileSizeWritten += ADPCM_BLOCK_SIZE / TOTAL_FILE_SIZE_UNITS_IN_BYTES;
+
+        AudioMoth_setRedLED(false);
+
+    }
+
+    /* Find the remaining capacity of the SD card which the file system keeps up to date as the file is allocated */
+
+    AM_freeSpace_t currentFreeSpace;
 
-    uint32_t guanoDataSize = writeGuanoData((char*)compressionBuffer, configSettings, currentTime, acousticLocationReceived, acousticLatitude, acousticLongitude, firmwareDescription, firmwareVersion, (uint8_t*)AM_UNIQUE_ID_START_ADDRESS, filename, extendedBatteryState, temperature);
+    uint32_t sdCardFreeSpace = AudioMoth_getFreeSpace(&currentFreeSpace) ? (uint64_t)currentFreeSpace.freeClusters * currentFreeSpace.clusterSize / NUMBER_OF_BYTES_IN_ONE_MB : UINT32_MAX;
 
-    FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(compressionBuffer, guanoDataSize));
+    /* Write the GUANO data with the time discarded while the microphone settled, which only applies to the first of back-to-back files */
+
+    uint32_t warmupDuration = followsPreviousRecording ? 0 : (uint32_t)((uint64_t)(dmaTransfersToSkip + 1) * numberOfSamplesInDMATransfer * MILLISECONDS_IN_SECOND / configSettings->sampleRate[*configurationIndexOfNextRecording]);
+
+    uint32_t guanoDataSize = writeGuanoData((char*)compressionBuffer, COMPRESSION_BUFFER_SIZE_IN_BYTES, configSettings, currentTime, acousticLocationReceived, acousticLatitude, acousticLongitude, firmwareDescription, firmwareVersion, (uint8_t*)AM_UNIQUE_ID_START_ADDRESS, filename, extendedBatteryState, temperature, rawCaptureEnabled, rawCaptureOffset, warmupDuration, sdCardFreeSpace);
+
+    if (!blockFileFormat) FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(compressionBuffer, guanoDataSize));
 
     /* Initialise the WAV header */
 
@@ -1344,15 +2722,39 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
     setHeaderDetails(&wavHeader, effectiveSampleRate, samplesWritten - numberOfSamplesInHeader - totalNumberOfCompressedSamples, guanoDataSize);
 
-    setHeaderComment(&wavHeader, currentTime, configSettings->timezoneHours, configSettings->timezoneMinutes, (uint8_t*)AM_UNIQUE_ID_START_ADDRESS, configSettings->gain[*configurationIndexOfNextRecording], extendedBatteryState, temperature, switchPositionChanged, supplyVoltageLow, fileSizeLimited, totalFileSizeLimited, configSettings->amplitudeThreshold[*configurationIndexOfNextRecording], requestedFilterType, configSettings->lowerFilterFreq[*configurationIndexOfNextRecording], configSettings->higherFilterFreq[*configurationIndexOfNextRecording]);
+    setHeaderComment(&wavHeader, currentTime, configSettings->timezoneHours, configSettings->timezoneMinutes, (uint8_t*)AM_UNIQUE_ID_START_ADDRESS, configSettings->gain[*configurationIndexOfNextRecording], extendedBatteryState, temperature, switchPositionChanged, supplyVoltageLow, fileSizeLimited, totalFileSizeLimited, sdCardFull, bufferOverflowed, configSettings->amplitudeThreshold[*configurationIndexOfNextRecording], requestedFilterType, configSettings->lowerFilterFreq[*configurationIndexOfNextRecording], configSettings->higherFilterFreq[*configurationIndexOfNextRecording]);
 
-    /* Write the header */
+    /* Write the header, or append it and the GUANO data to a block file as a trailer block so nothing before it is rewritten */
 
     if (enableLED) AudioMoth_setRedLED(true);
 
-    FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_seekInFile(0));
+    if (blockFileFormat) {
+
+        uint8_t *payloadSectors[] = {(uint8_t*)&wavHeader, (uint8_t*)compressionBuffer};
+
+        AudioMoth_getTime(&blockTime, &blockMilliseconds);
+
+        FLASH_LED_AND_RETURN_ON_ERROR(BlockFile_setTrailerBlock(blockHeader, blockSequenceNumber, samplesWritten, payloadSectors, sizeof(payloadSectors) / sizeof(uint8_t*), sizeof(wavHeader) + guanoDataSize, blockTime, blockMilliseconds));
+
+        AM_fileVector_t vectors[3] = {{blockHeader, BF_SECTOR_SIZE}, {&wavHeader, sizeof(wavHeader)}, {compressionBuffer, COMPRESSION_BUFFER_SIZE_IN_BYTES}};
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFileV(vectors, 3));
+
+    } else if (adpcmEncoding) {
+
+        setADPCMHeaderDetails(&adpcmWavHeader, &wavHeader, effectiveSampleRate, samplesWritten, guanoDataSize);
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_seekInFile(0));
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(&adpcmWavHeader, sizeof(adpcmWavHeader)));
 
-    FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(&wavHeader, sizeof(wavHeader)));
+    } else {
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_seekInFile(0));
+
+        FLASH_LED_AND_RETURN_ON_ERROR(AudioMoth_writeToFile(&wavHeader, sizeof(wavHeader)));
+
+    }
 
     /* Close the file */
 
@@ -1360,16 +2762,36 @@ static AM_recordingState_t makeRecording(uint32_t currentTime, uint32_t recordDu
 
     AudioMoth_setRedLED(false);
 
+    /* Add the file to the logs which are written once capture stops */
+
+    if (!followsPreviousRecording) {
+
+        strcpy(firstLoggedFilename, filename);
+
+        numberOfLoggedFiles = 0;
+
+    }
+
+    numberOfLoggedFiles += 1;
+
+    loggedConfigurationIndex = *configurationIndexOfNextRecording;
+
+    recordingLogPending = true;
+
     /* Return with state */
 
     if (switchPositionChanged) return SWITCH_CHANGED;
 
     if (supplyVoltageLow) return SUPPLY_VOLTAGE_LOW;
 
+    if (bufferOverflowed) return BUFFER_OVERFLOW;
+
     if (fileSizeLimited) return FILE_SIZE_LIMITED;
 
     if (totalFileSizeLimited) return TOTAL_FILE_SIZE_LIMITED;
 
+    if (sdCardFull) return SDCARD_FULL;
+
     return RECORDING_OKAY;
 
 }
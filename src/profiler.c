@@ -0,0 +1,311 @@
+/****************************************************************************
+ * profiler.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audiomoth.h"
+#include "profiler.h"
+#include "digitalfilter.h"
+
+/* Profiler constants */
+
+#define NUMBER_OF_HISTOGRAM_BINS        32
+
+#define MILLISECONDS_IN_SECOND          1000
+
+#define SUMMARY_BUFFER_LENGTH           640
+
+#define NUMBER_OF_BENCHMARK_REPEATS     16
+
+#define BENCHMARK_SAWTOOTH_PERIOD       64
+
+#define BENCHMARK_SAWTOOTH_STEP         512
+
+/* The recording hot path runs from flash in a build with RAMFUNC=0 */
+
+#ifdef AM_DISABLE_RAMFUNC
+
+#define HOT_PATH_LOCATION               "flash"
+
+#else
+
+#define HOT_PATH_LOCATION               "RAM"
+
+#endif
+
+#define RETURN_BOOL_ON_ERROR(fn) { \
+    bool success = (fn); \
+    if (success != true) { \
+        return success; \
+    } \
+}
+
+/* Profiler stage statistics */
+
+typedef struct {
+    uint32_t count;
+    uint32_t minimum;
+    uint32_t maximum;
+    uint64_t total;
+    uint32_t histogram[NUMBER_OF_HISTOGRAM_BINS];
+} stageStatistics_t;
+
+static stageStatistics_t stageStatistics[PR_NUMBER_OF_STAGES];
+
+static char *stageNames[PR_NUMBER_OF_STAGES] = {"DMA interrupt", "Filter", "Filter and threshold", "Write to file", "Encode compression", "Encode block header", "Lossless encode", "ADPCM encode", "Filter benchmark", "EM1 sleep"};
+
+/* Profiler timing variables */
+
+static uint32_t startSeconds;
+
+static uint32_t startMilliseconds;
+
+static uint32_t sleepStartSeconds;
+
+static uint32_t sleepStartMilliseconds;
+
+static uint32_t totalSleepMilliseconds;
+
+/* Write burst variables */
+
+static uint32_t numberOfBursts;
+
+static uint32_t maximumBurstSize;
+
+static uint64_t totalBurstSize;
+
+/* DMA transfer variables */
+
+static uint32_t numberOfTransfers;
+
+static uint32_t numberOfBuffers;
+
+static uint32_t firstTransferSeconds;
+
+static uint32_t firstTransferMilliseconds;
+
+static uint32_t transferMilliseconds;
+
+/* Summary buffer */
+
+static char summaryBuffer[SUMMARY_BUFFER_LENGTH];
+
+/* Private functions */
+
+static uint32_t millisecondsSince(uint32_t seconds, uint32_t milliseconds) {
+
+    uint32_t currentSeconds, currentMilliseconds;
+
+    AudioMoth_getTime(&currentSeconds, &currentMilliseconds);
+
+    return (currentSeconds - seconds) * MILLISECONDS_IN_SECOND + currentMilliseconds - milliseconds;
+
+}
+
+static uint32_t histogramBin(uint32_t cycles) {
+
+    uint32_t bin = 0;
+
+    while (cycles > 1 && bin < NUMBER_OF_HISTOGRAM_BINS - 1) {
+
+        cycles >>= 1;
+
+        bin += 1;
+
+    }
+
+    return bin;
+
+}
+
+/* Public functions */
+
+void Profiler_reset(void) {
+
+    for (uint32_t i = 0; i < PR_NUMBER_OF_STAGES; i += 1) {
+
+        stageStatistics_t *statistics = stageStatistics + i;
+
+        statistics->count = 0;
+        statistics->minimum = UINT32_MAX;
+        statistics->maximum = 0;
+        statistics->total = 0;
+
+        for (uint32_t j = 0; j < NUMBER_OF_HISTOGRAM_BINS; j += 1) statistics->histogram[j] = 0;
+
+    }
+
+    totalSleepMilliseconds = 0;
+
+    numberOfBursts = 0;
+
+    maximumBurstSize = 0;
+
+    totalBurstSize = 0;
+
+    numberOfTransfers = 0;
+
+    numberOfBuffers = 0;
+
+    transferMilliseconds = 0;
+
+    AudioMoth_enableCycleCounter();
+
+    AudioMoth_getTime(&startSeconds, &startMilliseconds);
+
+}
+
+void Profiler_addMeasurement(PR_stage_t stage, uint32_t cycles) {
+
+    stageStatistics_t *statistics = stageStatistics + stage;
+
+    statistics->count += 1;
+
+    statistics->total += cycles;
+
+    if (cycles < statistics->minimum) statistics->minimum = cycles;
+
+    if (cycles > statistics->maximum) statistics->maximum = cycles;
+
+    statistics->histogram[histogramBin(cycles)] += 1;
+
+}
+
+/* The cycle counter stops while the core sleeps so sleep is timed with the real time clock */
+
+void Profiler_startSleep(void) {
+
+    AudioMoth_getTime(&sleepStartSeconds, &sleepStartMilliseconds);
+
+}
+
+void Profiler_stopSleep(void) {
+
+    uint32_t milliseconds = millisecondsSince(sleepStartSeconds, sleepStartMilliseconds);
+
+    totalSleepMilliseconds += milliseconds;
+
+    Profiler_addMeasurement(PR_SLEEP, milliseconds * (AudioMoth_getCoreClockFrequency() / MILLISECONDS_IN_SECOND));
+
+}
+
+/* Each audio write to the SD card is a burst of one or more buffers and any compression marker before them */
+
+void Profiler_addBurst(AM_fileVector_t *vectors, uint32_t numberOfVectors) {
+
+    uint32_t burstSize = 0;
+
+    for (uint32_t i = 0; i < numberOfVectors; i += 1) burstSize += vectors[i].numberOfBytes;
+
+    numberOfBursts += 1;
+
+    totalBurstSize += burstSize;
+
+    if (burstSize > maximumBurstSize) maximumBurstSize = burstSize;
+
+}
+
+/* Each DMA interrupt after the warm-up delivers one transfer. Their rate against the real time clock shows whether a chained transfer interrupts once per chain as intended */
+
+void Profiler_addTransfer(bool bufferComplete) {
+
+    if (numberOfTransfers == 0) {
+
+        AudioMoth_getTime(&firstTransferSeconds, &firstTransferMilliseconds);
+
+    } else {
+
+        transferMilliseconds = millisecondsSince(firstTransferSeconds, firstTransferMilliseconds);
+
+    }
+
+    numberOfTransfers += 1;
+
+    if (bufferComplete) numberOfBuffers += 1;
+
+}
+
+/* Time the filter kernels on a synthetic block before capture starts, so builds with and without RAM functions can be compared on the same input. Each call covers the same number of samples as one DMA transfer */
+
+void Profiler_benchmarkDigitalFilter(int16_t *buffer, uint32_t numberOfSamples, uint32_t sampleRateDivider) {
+
+    for (uint32_t i = 0; i < NUMBER_OF_BENCHMARK_REPEATS; i += 1) {
+
+        for (uint32_t j = 0; j < numberOfSamples; j += 1) buffer[j] = (int16_t)((j % BENCHMARK_SAWTOOTH_PERIOD) * BENCHMARK_SAWTOOTH_STEP + INT16_MIN);
+
+        uint32_t start = AudioMoth_getCycleCount();
+
+        DigitalFilter_filter(buffer, buffer, sampleRateDivider, numberOfSamples, 0);
+
+        Profiler_addMeasurement(PR_FILTER_BENCHMARK, AudioMoth_getCycleCount() - start);
+
+    }
+
+    DigitalFilter_reset();
+
+}
+
+bool Profiler_writeSummary(char *filename, char *recordingFilename, uint32_t sampleRate, uint32_t sampleRateDivider, uint32_t numberOfSamplesInTransfer) {
+
+    uint32_t elapsedMilliseconds = millisecondsSince(startSeconds, startMilliseconds);
+
+    uint32_t sleepPercentage = elapsedMilliseconds == 0 ? 0 : (uint32_t)((uint64_t)1000 * totalSleepMilliseconds / elapsedMilliseconds);
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_appendFile(filename));
+
+    uint32_t length = sprintf(summaryBuffer, "%s - %lu Hz sample rate, divider %lu, %lu Hz clock, %lu Hz core clock, hot path in %s\n", recordingFilename, sampleRate, sampleRateDivider, AudioMoth_getClockFrequency(), AudioMoth_getCoreClockFrequency(), HOT_PATH_LOCATION);
+
+    length += sprintf(summaryBuffer + length, "EM1 sleep for %lu.%lu%% of %lu ms\n", sleepPercentage / 10, sleepPercentage % 10, elapsedMilliseconds);
+
+    uint32_t meanBurstSize = numberOfBursts == 0 ? 0 : totalBurstSize / numberOfBursts;
+
+    uint32_t expectedNumberOfTransfers = numberOfTransfers == 0 || numberOfSamplesInTransfer == 0 ? 0 : 1 + (uint64_t)transferMilliseconds * sampleRate / MILLISECONDS_IN_SECOND / numberOfSamplesInTransfer;
+
+    uint32_t transfersPerBuffer = numberOfBuffers == 0 ? 0 : 100 * numberOfTransfers / numberOfBuffers;
+
+    length += sprintf(summaryBuffer + length, "DMA interrupts %lu in %lu ms, %lu expected, %lu.%02lu per buffer\n", numberOfTransfers, transferMilliseconds, expectedNumberOfTransfers, transfersPerBuffer / 100, transfersPerBuffer % 100);
+
+    length += sprintf(summaryBuffer + length, "Write bursts %lu, mean %lu bytes, maximum %lu bytes\n", numberOfBursts, meanBurstSize, maximumBurstSize);
+
+    length += sprintf(summaryBuffer + length, "%-22s %10s %10s %10s %10s\n", "Stage (cycles)", "Count", "Minimum", "Mean", "Maximum");
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(summaryBuffer, length));
+
+    for (uint32_t i = 0; i < PR_NUMBER_OF_STAGES; i += 1) {
+
+        stageStatistics_t *statistics = stageStatistics + i;
+
+        if (statistics->count == 0) continue;
+
+        uint32_t mean = statistics->total / statistics->count;
+
+        length = sprintf(summaryBuffer, "%-22s %10lu %10lu %10lu %10lu\n", stageNames[i], statistics->count, statistics->minimum, mean, statistics->maximum);
+
+        /* Histogram of measurements by power of two cycle count */
+
+        length += sprintf(summaryBuffer + length, "%-22s", "");
+
+        for (uint32_t j = 0; j < NUMBER_OF_HISTOGRAM_BINS; j += 1) {
+
+            if (statistics->histogram[j] > 0) length += sprintf(summaryBuffer + length, " 2^%lu:%lu", j, statistics->histogram[j]);
+
+        }
+
+        length += sprintf(summaryBuffer + length, "\n");
+
+        RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(summaryBuffer, length));
+
+    }
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile("\n", 1));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_closeFile());
+
+    return true;
+
+}
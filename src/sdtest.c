@@ -0,0 +1,336 @@
+/****************************************************************************
+ * sdtest.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audiomoth.h"
+#include "sdtest.h"
+
+/* SD card test constants */
+
+#define SD_TEST_NUMBER_OF_BUFFERS       256
+
+#define SD_TEST_MARKER_INTERVAL         8
+
+#define SD_TEST_BLOCK_SIZE              512
+
+#define MAXIMUM_NUMBER_OF_WRITES        (3 * SD_TEST_NUMBER_OF_BUFFERS)
+
+#define MAXIMUM_TESTED_SAMPLE_RATE      1000000
+
+#define NUMBER_OF_BYTES_IN_SAMPLE       2
+
+#define MICROSECONDS_IN_SECOND          1000000
+
+#define PERMILLE_MULTIPLIER             1000
+
+#define MIN(a, b)                       ((a) < (b) ? (a) : (b))
+
+#define MAX(a, b)                       ((a) > (b) ? (a) : (b))
+
+#define RETURN_BOOL_ON_ERROR(fn) { \
+    bool success = (fn); \
+    if (success != true) { \
+        return success; \
+    } \
+}
+
+/* Write latency percentiles reported in permille */
+
+static const uint32_t percentiles[] = {500, 900, 990, 999};
+
+#define NUMBER_OF_PERCENTILES           (sizeof(percentiles) / sizeof(uint32_t))
+
+/* Test result structure */
+
+typedef struct {
+    uint32_t numberOfWrites;
+    uint32_t numberOfBytes;
+    uint32_t writeTime;
+    uint32_t totalTime;
+    uint32_t latencies[NUMBER_OF_PERCENTILES];
+    uint32_t maximumLatency;
+    uint32_t maximumSampleRate;
+} result_t;
+
+static result_t result;
+
+/* Measurement variables. Each buffer time includes any marker written before it */
+
+static uint32_t writeLatencies[MAXIMUM_NUMBER_OF_WRITES];
+
+static uint32_t bufferTimes[SD_TEST_NUMBER_OF_BUFFERS];
+
+static uint32_t cyclesPerMicrosecond;
+
+/* Header and marker block, as the recorder writes them from internal RAM */
+
+static uint8_t block[SD_TEST_BLOCK_SIZE] __attribute__ ((aligned(4)));
+
+/* Private functions */
+
+static uint32_t elapsedMicroseconds(uint32_t startCycles) {
+
+    return (AudioMoth_getCycleCount() - startCycles) / cyclesPerMicrosecond;
+
+}
+
+static bool timedWrite(AM_fileVector_t *vectors, uint32_t numberOfVectors, uint32_t *microseconds) {
+
+    uint32_t numberOfBytes = 0;
+
+    for (uint32_t i = 0; i < numberOfVectors; i += 1) numberOfBytes += vectors[i].numberOfBytes;
+
+    uint32_t startCycles = AudioMoth_getCycleCount();
+
+    bool success = AudioMoth_writeToFileV(vectors, numberOfVectors);
+
+    uint32_t latency = elapsedMicroseconds(startCycles);
+
+    if (result.numberOfWrites < MAXIMUM_NUMBER_OF_WRITES) writeLatencies[result.numberOfWrites] = latency;
+
+    result.numberOfWrites += 1;
+
+    result.numberOfBytes += numberOfBytes;
+
+    result.writeTime += latency;
+
+    *microseconds += latency;
+
+    return success;
+
+}
+
+static void sortLatencies(uint32_t numberOfLatencies) {
+
+    for (uint32_t i = 1; i < numberOfLatencies; i += 1) {
+
+        uint32_t latency = writeLatencies[i];
+
+        uint32_t j = i;
+
+        while (j > 0 && writeLatencies[j - 1] > latency) {
+
+            writeLatencies[j] = writeLatencies[j - 1];
+
+            j -= 1;
+
+        }
+
+        writeLatencies[j] = latency;
+
+    }
+
+}
+
+/* Replay the measured buffer times against a ring being filled at the sample rate. The writer starts on a buffer once it is full and must finish before the ring wraps round to refill it */
+
+static bool sustainsSampleRate(uint32_t sampleRate, uint32_t bufferSize, uint32_t numberOfBuffers) {
+
+    uint64_t fillTime = (uint64_t)bufferSize * MICROSECONDS_IN_SECOND / NUMBER_OF_BYTES_IN_SAMPLE / sampleRate;
+
+    uint64_t finishTime = 0;
+
+    for (uint32_t i = 0; i < SD_TEST_NUMBER_OF_BUFFERS; i += 1) {
+
+        uint64_t availableTime = (i + 1) * fillTime;
+
+        finishTime = MAX(finishTime, availableTime) + bufferTimes[i];
+
+        if (finishTime > (i + numberOfBuffers) * fillTime) return false;
+
+    }
+
+    return true;
+
+}
+
+static uint32_t findMaximumSampleRate(uint32_t bufferSize, uint32_t numberOfBuffers) {
+
+    uint32_t lower = 0;
+
+    uint32_t upper = MAXIMUM_TESTED_SAMPLE_RATE + 1;
+
+    while (upper - lower > 1) {
+
+        uint32_t sampleRate = lower + (upper - lower) / 2;
+
+        if (sustainsSampleRate(sampleRate, bufferSize, numberOfBuffers)) {
+
+            lower = sampleRate;
+
+        } else {
+
+            upper = sampleRate;
+
+        }
+
+    }
+
+    return lower;
+
+}
+
+/* Public functions */
+
+bool SDTest_run(char *filename, uint8_t *buffers, uint32_t bufferSize, uint32_t numberOfBuffers) {
+
+    memset(&result, 0, sizeof(result_t));
+
+    cyclesPerMicrosecond = MAX(1, AudioMoth_getCoreClockFrequency() / MICROSECONDS_IN_SECOND);
+
+    AudioMoth_enableCycleCounter();
+
+    /* Fill the ring with a ramp so each buffer holds different data */
+
+    uint16_t *samples = (uint16_t*)buffers;
+
+    for (uint32_t i = 0; i < numberOfBuffers * bufferSize / NUMBER_OF_BYTES_IN_SAMPLE; i += 1) samples[i] = i;
+
+    memset(block, 0, SD_TEST_BLOCK_SIZE);
+
+    /* Write at the same unit boundaries as the recorder */
+
+    uint32_t allocationUnitSize = AudioMoth_getSDCardAllocationUnitSize();
+
+    uint32_t writeUnitSize = allocationUnitSize == 0 ? numberOfBuffers * bufferSize : allocationUnitSize;
+
+    /* Open and preallocate the file with a placeholder header */
+
+    uint32_t numberOfMarkers = SD_TEST_NUMBER_OF_BUFFERS / SD_TEST_MARKER_INTERVAL;
+
+    uint32_t fileSize = SD_TEST_BLOCK_SIZE + SD_TEST_NUMBER_OF_BUFFERS * bufferSize + numberOfMarkers * SD_TEST_BLOCK_SIZE;
+
+    uint32_t startCycles = AudioMoth_getCycleCount();
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_openFile(filename));
+
+    AudioMoth_expandFile(fileSize);
+
+    result.totalTime += elapsedMicroseconds(startCycles);
+
+    uint32_t headerTime = 0;
+
+    AM_fileVector_t vectors[2] = {{block, SD_TEST_BLOCK_SIZE}};
+
+    RETURN_BOOL_ON_ERROR(timedWrite(vectors, 1, &headerTime));
+
+    /* Write the buffers, with a marker in place of the silent buffers every few buffers. The marker goes in the same transfer as the start of the buffer */
+
+    uint32_t bytesWrittenToFile = SD_TEST_BLOCK_SIZE;
+
+    for (uint32_t i = 0; i < SD_TEST_NUMBER_OF_BUFFERS; i += 1) {
+
+        bufferTimes[i] = 0;
+
+        uint32_t numberOfVectors = 0;
+
+        if (i % SD_TEST_MARKER_INTERVAL == SD_TEST_MARKER_INTERVAL - 1) {
+
+            vectors[numberOfVectors] = (AM_fileVector_t){block, SD_TEST_BLOCK_SIZE};
+
+            numberOfVectors += 1;
+
+            bytesWrittenToFile += SD_TEST_BLOCK_SIZE;
+
+        }
+
+        uint8_t *buffer = buffers + (i % numberOfBuffers) * bufferSize;
+
+        uint32_t bytesRemaining = bufferSize;
+
+        while (bytesRemaining > 0) {
+
+            uint32_t numberOfBytes = MIN(bytesRemaining, writeUnitSize - bytesWrittenToFile % writeUnitSize);
+
+            vectors[numberOfVectors] = (AM_fileVector_t){buffer + bufferSize - bytesRemaining, numberOfBytes};
+
+            numberOfVectors += 1;
+
+            RETURN_BOOL_ON_ERROR(timedWrite(vectors, numberOfVectors, bufferTimes + i));
+
+            numberOfVectors = 0;
+
+            bytesWrittenToFile += numberOfBytes;
+
+            bytesRemaining -= numberOfBytes;
+
+        }
+
+    }
+
+    /* Rewrite the header at the start of the file and close it */
+
+    startCycles = AudioMoth_getCycleCount();
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_seekInFile(0));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_writeToFile(block, SD_TEST_BLOCK_SIZE));
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_closeFile());
+
+    result.totalTime += result.writeTime + elapsedMicroseconds(startCycles);
+
+    RETURN_BOOL_ON_ERROR(AudioMoth_deleteFile(filename));
+
+    /* Calculate the latency percentiles and the maximum sample rate */
+
+    uint32_t numberOfLatencies = MIN(result.numberOfWrites, MAXIMUM_NUMBER_OF_WRITES);
+
+    sortLatencies(numberOfLatencies);
+
+    for (uint32_t i = 0; i < NUMBER_OF_PERCENTILES; i += 1) {
+
+        result.latencies[i] = writeLatencies[(numberOfLatencies - 1) * percentiles[i] / PERMILLE_MULTIPLIER];
+
+    }
+
+    result.maximumLatency = writeLatencies[numberOfLatencies - 1];
+
+    result.maximumSampleRate = findMaximumSampleRate(bufferSize, numberOfBuffers);
+
+    return true;
+
+}
+
+uint32_t SDTest_writeResult(char *buffer, char *speedName, bool success) {
+
+    if (!success) return sprintf(buffer, "%s: test failed\n\n", speedName);
+
+    uint32_t writeRate = result.writeTime == 0 ? 0 : (uint64_t)result.numberOfBytes * 100 / result.writeTime;
+
+    uint32_t totalRate = result.totalTime == 0 ? 0 : (uint64_t)result.numberOfBytes * 100 / result.totalTime;
+
+    uint32_t length = sprintf(buffer, "%s: %lu bytes in %lu writes, %lu.%02lu MB/s sustained, %lu.%02lu MB/s including open and close\n", speedName, result.numberOfBytes, result.numberOfWrites, writeRate / 100, writeRate % 100, totalRate / 100, totalRate % 100);
+
+    length += sprintf(buffer + length, "Write latency (us):");
+
+    for (uint32_t i = 0; i < NUMBER_OF_PERCENTILES; i += 1) {
+
+        uint32_t percentile = percentiles[i];
+
+        if (percentile % 10 == 0) {
+
+            length += sprintf(buffer + length, " p%lu %lu,", percentile / 10, result.latencies[i]);
+
+        } else {
+
+            length += sprintf(buffer + length, " p%lu.%lu %lu,", percentile / 10, percentile % 10, result.latencies[i]);
+
+        }
+
+    }
+
+    length += sprintf(buffer + length, " max %lu\n", result.maximumLatency);
+
+    length += sprintf(buffer + length, "Maximum sample rate without ring overrun: %lu Hz\n\n", result.maximumSampleRate);
+
+    return length;
+
+}
@@ -0,0 +1,345 @@
+/****************************************************************************
+ * blockfile2wav.cpp
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+/* Converts a block file recording to a WAV file on the host. The block file and lossless modules are the firmware's own C sources, so they
+   are compiled as C and linked in. Build from the repository root with:
+
+   cc -c -DAM_DISABLE_RAMFUNC -Iinc src/blockfile.c src/lossless.c
+   c++ -std=c++11 -DAM_DISABLE_RAMFUNC -Iinc -o blockfile2wav tools/blockfile2wav.cpp blockfile.o lossless.o
+
+   Blocks are read until the first one which is missing or fails its CRC, so a file cut short by a power failure is converted up to that point */
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+extern "C" {
+
+#include "blockfile.h"
+#include "lossless.h"
+
+}
+
+/* WAV header constants */
+
+#define WAV_HEADER_SIZE                         512
+
+#define RIFF_SIZE_OFFSET                        4
+#define DATA_SIZE_OFFSET                        (WAV_HEADER_SIZE - 4)
+
+#define FMT_CHUNK_SIZE                          16
+#define JUNK_CHUNK_OFFSET                       36
+
+#define PCM_FORMAT                              1
+
+#define NUMBER_OF_BYTES_IN_SAMPLE               2
+
+#define ZERO_BUFFER_SIZE_IN_SAMPLES             4096
+
+/* Block reader. The payload and decoded sample buffers grow to fit the largest block seen */
+
+class BlockReader {
+
+public:
+
+    explicit BlockReader(std::istream &input) : input(input) { }
+
+    BF_blockHeader_t *header() { return reinterpret_cast<BF_blockHeader_t*>(sector); }
+
+    uint8_t *sectorData() { return sector; }
+
+    uint8_t *payload() { return payloadBuffer.data(); }
+
+    const int16_t *decodedSamples() const { return decodedBuffer.data(); }
+
+    bool readBlock();
+
+    bool decodeCompressedBlock();
+
+private:
+
+    std::istream &input;
+
+    uint8_t sector[BF_SECTOR_SIZE];
+
+    std::vector<uint8_t> payloadBuffer;
+
+    std::vector<int16_t> decodedBuffer;
+
+};
+
+bool BlockReader::readBlock() {
+
+    if (!input.read(reinterpret_cast<char*>(sector), BF_SECTOR_SIZE)) return false;
+
+    if (header()->magic != BF_BLOCK_MAGIC) return false;
+
+    uint32_t payloadSize = BlockFile_getNumberOfPayloadSectors(header()) * BF_SECTOR_SIZE;
+
+    if (payloadSize > payloadBuffer.size()) payloadBuffer.resize(payloadSize);
+
+    if (payloadSize > 0 && !input.read(reinterpret_cast<char*>(payloadBuffer.data()), payloadSize)) return false;
+
+    return BlockFile_isValidBlock(sector, payloadBuffer.data());
+
+}
+
+bool BlockReader::decodeCompressedBlock() {
+
+    uint32_t numberOfSamples = header()->numberOfSamples;
+
+    uint32_t numberOfFrames = Lossless_getNumberOfFrames(numberOfSamples);
+
+    if (numberOfFrames > BF_MAXIMUM_NUMBER_OF_FRAMES) return false;
+
+    uint16_t frameSizes[BF_MAXIMUM_NUMBER_OF_FRAMES];
+
+    std::memcpy(frameSizes, sector + sizeof(BF_blockHeader_t), numberOfFrames * sizeof(uint16_t));
+
+    uint32_t numberOfBytes = 0;
+
+    for (uint32_t i = 0; i < numberOfFrames; i += 1) numberOfBytes += frameSizes[i];
+
+    if (numberOfBytes != header()->payloadSize) return false;
+
+    if (numberOfSamples > decodedBuffer.size()) decodedBuffer.resize(numberOfSamples);
+
+    return Lossless_decode(payloadBuffer.data(), frameSizes, decodedBuffer.data(), numberOfSamples);
+
+}
+
+/* Private functions */
+
+static void writeUint16(uint8_t *buffer, uint16_t value) {
+
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+
+}
+
+static void writeUint32(uint8_t *buffer, uint32_t value) {
+
+    writeUint16(buffer, value & 0xFFFF);
+    writeUint16(buffer + 2, value >> 16);
+
+}
+
+static void setDefaultHeader(uint8_t *header, uint32_t sampleRate, uint16_t numberOfChannels, uint16_t bitsPerSample) {
+
+    std::memset(header, 0, WAV_HEADER_SIZE);
+
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 8, "WAVE", 4);
+
+    std::memcpy(header + 12, "fmt ", 4);
+    writeUint32(header + 16, FMT_CHUNK_SIZE);
+    writeUint16(header + 20, PCM_FORMAT);
+    writeUint16(header + 22, numberOfChannels);
+    writeUint32(header + 24, sampleRate);
+    writeUint32(header + 28, sampleRate * numberOfChannels * bitsPerSample / 8);
+    writeUint16(header + 32, numberOfChannels * bitsPerSample / 8);
+    writeUint16(header + 34, bitsPerSample);
+
+    std::memcpy(header + JUNK_CHUNK_OFFSET, "JUNK", 4);
+    writeUint32(header + JUNK_CHUNK_OFFSET + 4, DATA_SIZE_OFFSET - 4 - JUNK_CHUNK_OFFSET - 8);
+
+    std::memcpy(header + DATA_SIZE_OFFSET - 4, "data", 4);
+
+}
+
+static void writeBytes(std::ostream &output, const void *bytes, uint64_t numberOfBytes) {
+
+    output.write(static_cast<const char*>(bytes), numberOfBytes);
+
+}
+
+static void writeSilence(std::ostream &output, uint64_t numberOfSamples) {
+
+    static const int16_t zeroBuffer[ZERO_BUFFER_SIZE_IN_SAMPLES] = {0};
+
+    while (numberOfSamples > 0 && output) {
+
+        uint64_t numberOfSamplesToWrite = std::min<uint64_t>(numberOfSamples, ZERO_BUFFER_SIZE_IN_SAMPLES);
+
+        writeBytes(output, zeroBuffer, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesToWrite);
+
+        numberOfSamples -= numberOfSamplesToWrite;
+
+    }
+
+}
+
+/* Main function */
+
+int main(int argc, char **argv) {
+
+    if (argc != 3) {
+
+        std::cerr << "Usage: " << argv[0] << " INPUT.DAT OUTPUT.WAV" << std::endl;
+
+        return EXIT_FAILURE;
+
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+
+    if (!input) {
+
+        std::cerr << "Could not open " << argv[1] << std::endl;
+
+        return EXIT_FAILURE;
+
+    }
+
+    /* The file must start with a valid file header block */
+
+    BlockReader reader(input);
+
+    if (!reader.readBlock() || reader.header()->type != BF_FILE_HEADER) {
+
+        std::cerr << argv[1] << " is not a block file" << std::endl;
+
+        return EXIT_FAILURE;
+
+    }
+
+    BF_fileDescription_t description;
+
+    std::memcpy(&description, reader.sectorData() + sizeof(BF_blockHeader_t), sizeof(BF_fileDescription_t));
+
+    if (description.version != BF_FILE_VERSION || description.bitsPerSample != 8 * NUMBER_OF_BYTES_IN_SAMPLE) {
+
+        std::cerr << argv[1] << " has an unsupported version or sample format" << std::endl;
+
+        return EXIT_FAILURE;
+
+    }
+
+    std::ofstream output(argv[2], std::ios::binary);
+
+    if (!output) {
+
+        std::cerr << "Could not open " << argv[2] << std::endl;
+
+        return EXIT_FAILURE;
+
+    }
+
+    /* Leave space for the header which is written once the number of samples is known */
+
+    uint8_t header[WAV_HEADER_SIZE];
+
+    setDefaultHeader(header, description.sampleRate, description.numberOfChannels, description.bitsPerSample);
+
+    writeBytes(output, header, WAV_HEADER_SIZE);
+
+    /* Copy the samples, filling any gap left by a missing block with silence */
+
+    uint64_t samplesWritten = 0;
+
+    std::vector<uint8_t> guanoData;
+
+    bool trailerFound = false;
+
+    while (!trailerFound && reader.readBlock()) {
+
+        BF_blockHeader_t *blockHeader = reader.header();
+
+        if (blockHeader->type == BF_TRAILER) {
+
+            /* The trailer holds the WAV header written by the device followed by the GUANO data */
+
+            if (blockHeader->payloadSize >= WAV_HEADER_SIZE) {
+
+                std::memcpy(header, reader.payload(), WAV_HEADER_SIZE);
+
+                guanoData.assign(reader.payload() + WAV_HEADER_SIZE, reader.payload() + blockHeader->payloadSize);
+
+            }
+
+            trailerFound = true;
+
+            continue;
+
+        }
+
+        if (blockHeader->type == BF_FILE_HEADER) continue;
+
+        if (blockHeader->type == BF_COMPRESSED_AUDIO && !reader.decodeCompressedBlock()) {
+
+            std::cerr << "Block " << blockHeader->sequenceNumber << " could not be decoded" << std::endl;
+
+            break;
+
+        }
+
+        if (blockHeader->sampleIndex > samplesWritten) {
+
+            std::cerr << "Missing samples " << samplesWritten << " to " << blockHeader->sampleIndex << " filled with silence" << std::endl;
+
+            writeSilence(output, blockHeader->sampleIndex - samplesWritten);
+
+            samplesWritten = blockHeader->sampleIndex;
+
+        }
+
+        uint64_t overlap = samplesWritten - blockHeader->sampleIndex;
+
+        if (overlap >= blockHeader->numberOfSamples) continue;
+
+        uint32_t numberOfSamples = blockHeader->numberOfSamples - overlap;
+
+        if (blockHeader->type == BF_SILENCE) {
+
+            writeSilence(output, numberOfSamples);
+
+        } else if (blockHeader->type == BF_COMPRESSED_AUDIO) {
+
+            writeBytes(output, reader.decodedSamples() + overlap, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamples);
+
+        } else {
+
+            writeBytes(output, reader.payload() + NUMBER_OF_BYTES_IN_SAMPLE * overlap, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamples);
+
+        }
+
+        samplesWritten += numberOfSamples;
+
+    }
+
+    if (!trailerFound) std::cerr << argv[1] << " is incomplete and was converted up to sample " << samplesWritten << std::endl;
+
+    /* Append the GUANO data and complete the header */
+
+    if (!guanoData.empty()) writeBytes(output, guanoData.data(), guanoData.size());
+
+    uint64_t dataSize = NUMBER_OF_BYTES_IN_SAMPLE * samplesWritten;
+
+    uint64_t riffSize = WAV_HEADER_SIZE - 8 + dataSize + guanoData.size();
+
+    if (riffSize > UINT32_MAX) std::cerr << argv[2] << " is larger than a WAV file can describe" << std::endl;
+
+    writeUint32(header + RIFF_SIZE_OFFSET, std::min<uint64_t>(riffSize, UINT32_MAX));
+
+    writeUint32(header + DATA_SIZE_OFFSET, std::min<uint64_t>(dataSize, UINT32_MAX));
+
+    output.seekp(0);
+
+    writeBytes(output, header, WAV_HEADER_SIZE);
+
+    output.close();
+
+    bool success = !output.fail();
+
+    if (!success) std::cerr << "Could not write " << argv[2] << std::endl;
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
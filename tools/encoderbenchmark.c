@@ -0,0 +1,426 @@
+/****************************************************************************
+ * encoderbenchmark.c
+ * openacousticdevices.info
+ * October 2026
+ *****************************************************************************/
+
+/* Measures the lossless and IMA-ADPCM encoders on the host at each sample rate the device supports. Build from the repository root with:
+
+   cc -O3 -DAM_DISABLE_RAMFUNC -Iinc -o encoderbenchmark tools/encoderbenchmark.c src/lossless.c src/adpcm.c -lm
+
+   With no arguments a synthetic soundscape is generated at each sample rate. Otherwise each argument is a 16-bit mono WAV file which is
+   encoded at its own sample rate. Every lossless block is decoded again and compared with the original, and the ADPCM stream is decoded to
+   report its signal to noise ratio against the PCM samples. Host cycle counts are only a guide to the device, whose own figures are in the
+   "Lossless encode" and "ADPCM encode" stages of PROFILE.TXT when the firmware is built with profiling enabled */
+
+#include <time.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER                       1
+#endif
+
+#include "lossless.h"
+#include "adpcm.h"
+
+/* Benchmark constants */
+
+#define NUMBER_OF_SAMPLES_IN_BUFFER             16384
+
+#define SYNTHETIC_DURATION_IN_SECONDS           10
+
+#define WAV_HEADER_SEARCH_LIMIT                 4096
+
+#define NUMBER_OF_BYTES_IN_SAMPLE               2
+
+#define NANOSECONDS_IN_SECOND                   1000000000ULL
+
+#define MIN(a, b)                               ((a) < (b) ? (a) : (b))
+
+static const uint32_t sampleRates[] = {8000, 16000, 32000, 48000, 96000, 192000, 250000, 384000};
+
+#define NUMBER_OF_SAMPLE_RATES                  (sizeof(sampleRates) / sizeof(uint32_t))
+
+/* Block buffers */
+
+static int16_t block[NUMBER_OF_SAMPLES_IN_BUFFER];
+
+static int16_t decoded[NUMBER_OF_SAMPLES_IN_BUFFER];
+
+static uint16_t frameSizes[LL_MAXIMUM_NUMBER_OF_FRAMES];
+
+static uint8_t partialBlocks[2][ADPCM_BLOCK_SIZE];
+
+/* IMA-ADPCM decoder tables */
+
+static const int16_t stepTable[] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+/* Private functions */
+
+static uint64_t getNanoseconds(void) {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * NANOSECONDS_IN_SECOND + now.tv_nsec;
+
+}
+
+static uint64_t getCycles(void) {
+
+#ifdef HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+
+}
+
+/* Background noise with a falling spectrum, wind-like swells and an occasional frequency-swept call */
+
+static void generateSoundscape(int16_t *samples, uint32_t numberOfSamples, uint32_t sampleRate) {
+
+    uint32_t seed = 1;
+
+    double brown = 0, pink = 0, phase = 0;
+
+    for (uint32_t i = 0; i < numberOfSamples; i += 1) {
+
+        seed = seed * 1664525 + 1013904223;
+
+        double white = (double)(int32_t)seed / 2147483648.0;
+
+        brown = 0.999 * brown + 0.02 * white;
+
+        pink = 0.9 * pink + 0.1 * white;
+
+        double t = (double)i / sampleRate;
+
+        double swell = 1.0 + 0.5 * sin(2 * M_PI * 0.2 * t);
+
+        double sample = 600 * swell * brown + 150 * pink + 40 * white;
+
+        double callTime = fmod(t, 1.5);
+
+        if (callTime < 0.3) {
+
+            double frequency = MIN(2000 + 20000 * callTime, 0.4 * sampleRate);
+
+            phase += 2 * M_PI * frequency / sampleRate;
+
+            sample += 3000 * sin(M_PI * callTime / 0.3) * sin(phase);
+
+        }
+
+        samples[i] = (int16_t)sample;
+
+    }
+
+}
+
+static int16_t* readWavFile(char *filename, uint32_t *numberOfSamples, uint32_t *sampleRate) {
+
+    FILE *file = fopen(filename, "rb");
+
+    if (file == NULL) return NULL;
+
+    uint8_t header[WAV_HEADER_SEARCH_LIMIT];
+
+    uint32_t length = fread(header, 1, WAV_HEADER_SEARCH_LIMIT, file);
+
+    uint32_t dataOffset = 0, dataSize = 0;
+
+    *sampleRate = 0;
+
+    for (uint32_t offset = 12; offset + 8 <= length; ) {
+
+        uint32_t chunkSize = header[offset + 4] | header[offset + 5] << 8 | header[offset + 6] << 16 | (uint32_t)header[offset + 7] << 24;
+
+        if (memcmp(header + offset, "fmt ", 4) == 0 && offset + 16 <= length) {
+
+            uint32_t numberOfChannels = header[offset + 10] | header[offset + 11] << 8;
+
+            uint32_t bitsPerSample = header[offset + 22] | header[offset + 23] << 8;
+
+            if (numberOfChannels == 1 && bitsPerSample == 16) *sampleRate = header[offset + 12] | header[offset + 13] << 8 | header[offset + 14] << 16 | (uint32_t)header[offset + 15] << 24;
+
+        }
+
+        if (memcmp(header + offset, "data", 4) == 0) {
+
+            dataOffset = offset + 8;
+
+            dataSize = chunkSize;
+
+            break;
+
+        }
+
+        offset += 8 + chunkSize + (chunkSize & 1);
+
+    }
+
+    int16_t *samples = NULL;
+
+    if (*sampleRate > 0 && dataOffset > 0) {
+
+        *numberOfSamples = dataSize / NUMBER_OF_BYTES_IN_SAMPLE;
+
+        samples = malloc(dataSize);
+
+        fseek(file, dataOffset, SEEK_SET);
+
+        if (samples != NULL) *numberOfSamples = fread(samples, NUMBER_OF_BYTES_IN_SAMPLE, *numberOfSamples, file);
+
+    }
+
+    fclose(file);
+
+    return samples;
+
+}
+
+/* Decode a block independently of the encoder, as a standard WAV reader would */
+
+static void decodeADPCMBlock(uint8_t *block, int16_t *samples) {
+
+    int32_t predictor = (int16_t)(block[0] | block[1] << 8);
+
+    int32_t stepIndex = MIN(block[2], sizeof(stepTable) / sizeof(int16_t) - 1);
+
+    samples[0] = predictor;
+
+    for (uint32_t i = 1; i < ADPCM_SAMPLES_PER_BLOCK; i += 1) {
+
+        uint8_t byte = block[ADPCM_BLOCK_HEADER_SIZE + (i - 1) / 2];
+
+        uint32_t nibble = (i - 1) & 1 ? byte >> 4 : byte & 0x0F;
+
+        int32_t step = stepTable[stepIndex];
+
+        int32_t difference = step >> 3;
+
+        if (nibble & 4) difference += step;
+        if (nibble & 2) difference += step >> 1;
+        if (nibble & 1) difference += step >> 2;
+
+        predictor += nibble & 8 ? -difference : difference;
+
+        predictor = predictor < INT16_MIN ? INT16_MIN : predictor > INT16_MAX ? INT16_MAX : predictor;
+
+        stepIndex += indexTable[nibble];
+
+        stepIndex = stepIndex < 0 ? 0 : MIN(stepIndex, (int32_t)(sizeof(stepTable) / sizeof(int16_t) - 1));
+
+        samples[i] = predictor;
+
+    }
+
+}
+
+/* Encode the whole stream in SRAM sized pieces as the device does, then decode it and compare with the samples */
+
+static double measureADPCM(int16_t *samples, uint32_t numberOfSamples, uint64_t *nanoseconds, uint64_t *cycles) {
+
+    uint32_t numberOfBlocks = (numberOfSamples + ADPCM_SAMPLES_PER_BLOCK - 1) / ADPCM_SAMPLES_PER_BLOCK;
+
+    uint8_t *stream = malloc((size_t)numberOfBlocks * ADPCM_BLOCK_SIZE);
+
+    int16_t *decodedBlock = malloc(ADPCM_SAMPLES_PER_BLOCK * NUMBER_OF_BYTES_IN_SAMPLE);
+
+    if (stream == NULL || decodedBlock == NULL) return 0;
+
+    uint32_t streamSize = 0;
+
+    ADPCM_reset(partialBlocks[0], partialBlocks[1]);
+
+    for (uint32_t start = 0; start < numberOfSamples; start += NUMBER_OF_SAMPLES_IN_BUFFER) {
+
+        uint32_t numberOfSamplesInBlock = MIN(NUMBER_OF_SAMPLES_IN_BUFFER, numberOfSamples - start);
+
+        memcpy(block, samples + start, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesInBlock);
+
+        uint8_t *completedBlock;
+
+        uint64_t startNanoseconds = getNanoseconds();
+
+        uint64_t startCycles = getCycles();
+
+        uint32_t numberOfBytes = ADPCM_encode(block, numberOfSamplesInBlock, &completedBlock);
+
+        *cycles += getCycles() - startCycles;
+
+        *nanoseconds += getNanoseconds() - startNanoseconds;
+
+        if (completedBlock != NULL) {
+
+            memcpy(stream + streamSize, completedBlock, ADPCM_BLOCK_SIZE);
+
+            streamSize += ADPCM_BLOCK_SIZE;
+
+        }
+
+        memcpy(stream + streamSize, block, numberOfBytes);
+
+        streamSize += numberOfBytes;
+
+    }
+
+    uint8_t *lastBlock = ADPCM_flush();
+
+    if (lastBlock != NULL) {
+
+        memcpy(stream + streamSize, lastBlock, ADPCM_BLOCK_SIZE);
+
+        streamSize += ADPCM_BLOCK_SIZE;
+
+    }
+
+    double signal = 0, noise = 0;
+
+    for (uint32_t i = 0; i < numberOfBlocks; i += 1) {
+
+        decodeADPCMBlock(stream + i * ADPCM_BLOCK_SIZE, decodedBlock);
+
+        for (uint32_t j = 0; j < ADPCM_SAMPLES_PER_BLOCK && i * ADPCM_SAMPLES_PER_BLOCK + j < numberOfSamples; j += 1) {
+
+            double sample = samples[i * ADPCM_SAMPLES_PER_BLOCK + j];
+
+            double error = sample - decodedBlock[j];
+
+            signal += sample * sample;
+
+            noise += error * error;
+
+        }
+
+    }
+
+    free(stream);
+
+    free(decodedBlock);
+
+    if (streamSize != numberOfBlocks * ADPCM_BLOCK_SIZE) return 0;
+
+    return noise == 0 ? INFINITY : 10 * log10(signal / noise);
+
+}
+
+/* Encode in SRAM sized blocks as the device does */
+
+static bool benchmark(char *name, int16_t *samples, uint32_t numberOfSamples, uint32_t sampleRate) {
+
+    uint64_t totalBytes = 0, totalNanoseconds = 0, totalCycles = 0;
+
+    for (uint32_t start = 0; start < numberOfSamples; start += NUMBER_OF_SAMPLES_IN_BUFFER) {
+
+        uint32_t numberOfSamplesInBlock = MIN(NUMBER_OF_SAMPLES_IN_BUFFER, numberOfSamples - start);
+
+        memcpy(block, samples + start, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesInBlock);
+
+        uint32_t peakLevel;
+
+        uint64_t startNanoseconds = getNanoseconds();
+
+        uint64_t startCycles = getCycles();
+
+        uint32_t numberOfBytes = Lossless_encode(block, numberOfSamplesInBlock, frameSizes, &peakLevel);
+
+        totalCycles += getCycles() - startCycles;
+
+        totalNanoseconds += getNanoseconds() - startNanoseconds;
+
+        totalBytes += numberOfBytes;
+
+        if (!Lossless_decode((uint8_t*)block, frameSizes, decoded, numberOfSamplesInBlock) || memcmp(decoded, samples + start, NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamplesInBlock) != 0) {
+
+            fprintf(stderr, "%s: decoded samples do not match at block starting %lu\n", name, (unsigned long)start);
+
+            return false;
+
+        }
+
+    }
+
+    double ratio = 100.0 * totalBytes / ((double)NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamples);
+
+    uint64_t adpcmNanoseconds = 0, adpcmCycles = 0;
+
+    double signalToNoiseRatio = measureADPCM(samples, numberOfSamples, &adpcmNanoseconds, &adpcmCycles);
+
+    printf("%-24s %8lu %12lu %9.1f%% %10.2f %10.2f %10.2f %10.2f %9.1f\n", name, (unsigned long)sampleRate, (unsigned long)numberOfSamples, ratio, (double)totalNanoseconds / numberOfSamples, (double)totalCycles / numberOfSamples, (double)adpcmNanoseconds / numberOfSamples, (double)adpcmCycles / numberOfSamples, signalToNoiseRatio);
+
+    return true;
+
+}
+
+/* Main function */
+
+int main(int argc, char **argv) {
+
+    bool success = true;
+
+    printf("%-24s %8s %12s %10s %10s %10s %10s %10s %9s\n", "", "", "", "Lossless", "", "", "ADPCM", "", "");
+
+    printf("%-24s %8s %12s %10s %10s %10s %10s %10s %9s\n", "Source", "Rate", "Samples", "Size", "ns/sample", "cyc/sample", "ns/sample", "cyc/sample", "SNR (dB)");
+
+    if (argc == 1) {
+
+        for (uint32_t i = 0; i < NUMBER_OF_SAMPLE_RATES; i += 1) {
+
+            uint32_t numberOfSamples = sampleRates[i] * SYNTHETIC_DURATION_IN_SECONDS;
+
+            int16_t *samples = malloc(NUMBER_OF_BYTES_IN_SAMPLE * numberOfSamples);
+
+            if (samples == NULL) return EXIT_FAILURE;
+
+            generateSoundscape(samples, numberOfSamples, sampleRates[i]);
+
+            success &= benchmark("Synthetic soundscape", samples, numberOfSamples, sampleRates[i]);
+
+            free(samples);
+
+        }
+
+    }
+
+    for (int i = 1; i < argc; i += 1) {
+
+        uint32_t numberOfSamples, sampleRate;
+
+        int16_t *samples = readWavFile(argv[i], &numberOfSamples, &sampleRate);
+
+        if (samples == NULL) {
+
+            fprintf(stderr, "%s is not a 16-bit mono WAV file\n", argv[i]);
+
+            success = false;
+
+            continue;
+
+        }
+
+        success &= benchmark(argv[i], samples, numberOfSamples, sampleRate);
+
+        free(samples);
+
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}